@@ -0,0 +1,104 @@
+/**
+ * \brief Element access benchmark of the dd containers. Built twice by cmake
+ * (access_bench_checked & access_bench_unchecked w/ DD_CHECKED_ACCESS 1 & 0)
+ * so the same loops time checked vs unchecked operator[] & GetElement. Run
+ * both w/ the run_access_bench target (use a Release build)
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "Container.h"
+
+namespace {
+
+const unsigned passes = 100;
+const unsigned trials = 5;
+
+typedef std::chrono::steady_clock bench_clock;
+
+double elapsed_ms(const bench_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start)
+      .count();
+}
+
+/** \brief c[i] = a[i] * b[i] + c[i] thru dd_array::operator[] */
+double array_loop(const dd_array<float> &a, const dd_array<float> &b,
+                  dd_array<float> &c, const size_t n) {
+  const bench_clock::time_point start = bench_clock::now();
+  for (unsigned p = 0; p < passes; p++) {
+    for (size_t i = 0; i < n; i++) c[i] = a[i] * b[i] + c[i];
+  }
+  return elapsed_ms(start);
+}
+
+/** \brief Planar 2D affine (shape of the canonical transform) in place */
+double affine_loop(dd_array<float> &x, dd_array<float> &y, const size_t n) {
+  const float m00 = 0.8f, m01 = -0.6f, m10 = 0.6f, m11 = 0.8f;
+  const bench_clock::time_point start = bench_clock::now();
+  for (unsigned p = 0; p < passes; p++) {
+    for (size_t i = 0; i < n; i++) {
+      const float px = x[i], py = y[i];
+      x[i] = m00 * px + m01 * py + 0.5f;
+      y[i] = m10 * px + m11 * py - 0.5f;
+    }
+  }
+  return elapsed_ms(start);
+}
+
+/** \brief m(i, j) += a[j] thru dd_2Darray::GetElement */
+double grid_loop(const dd_array<float> &a, dd_2Darray<float> &m,
+                 const size_t rows, const size_t cols) {
+  const bench_clock::time_point start = bench_clock::now();
+  for (unsigned p = 0; p < passes; p++) {
+    for (size_t i = 0; i < rows; i++) {
+      for (size_t j = 0; j < cols; j++) m.GetElement(i, j) += a[j];
+    }
+  }
+  return elapsed_ms(start);
+}
+
+/** \brief Keep the fastest of each trial */
+void keep_best(const double ms, const unsigned trial, double &best) {
+  if (trial == 0 || ms < best) best = ms;
+}
+
+}  // namespace
+
+int main(int argc, char const *argv[]) {
+  // sizes are only known at run time (as in the tool), optional argv[1]
+  const size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1 << 20;
+  const size_t rows = 1024, cols = n / rows;
+  if (cols == 0) {
+    printf("access_bench: size must be at least %zu\n", rows);
+    return 1;
+  }
+
+  dd_array<float> a(n), b(n), c(n), x(n), y(n);
+  for (size_t i = 0; i < n; i++) {
+    a[i] = (float)(i % 1000) * 0.001f;
+    b[i] = 0.5f;
+    x[i] = a[i];
+    y[i] = 1.f - a[i];
+  }
+  dd_2Darray<float> m(rows, cols);
+  for (size_t i = 0; i < rows; i++) {
+    for (size_t j = 0; j < cols; j++) m.GetElement(i, j) = 0.f;
+  }
+
+  // best of a few trials (results are printed so loops aren't optimized out)
+  double array_ms = 0.0, affine_ms = 0.0, grid_ms = 0.0;
+  for (unsigned t = 0; t < trials; t++) {
+    keep_best(array_loop(a, b, c, n), t, array_ms);
+    keep_best(affine_loop(x, y, n), t, affine_ms);
+    keep_best(grid_loop(a, m, rows, cols), t, grid_ms);
+  }
+
+  printf("DD_CHECKED_ACCESS=%d (%zu floats x %u passes, best of %u)\n",
+         DD_CHECKED_ACCESS, n, passes, trials);
+  printf("  dd_array operator[] fma     %8.1f ms\n", array_ms);
+  printf("  dd_array operator[] affine  %8.1f ms\n", affine_ms);
+  printf("  dd_2Darray GetElement       %8.1f ms\n", grid_ms);
+  printf("  (checksum %g %g %g)\n", c[n - 1], x[n / 2],
+         m.GetElement(3, 5));
+  return 0;
+}
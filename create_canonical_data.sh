@@ -7,37 +7,17 @@ PARSER_EXE=./bin/fk_data
 SOURCE_DATA=smile_data/
 Q_IN=queries_in.txt
 Q_GT=queries_groundtruth.txt
+F_SPEC=mouth_features.txt
 if [[ $# == 1 ]]; then
 	PARSER_EXE=./$1/bin/fk_data
 	SOURCE_DATA=$1/smile_data/
 	Q_IN=$1/queries_in.txt
 	Q_GT=$1/queries_groundtruth.txt
+	F_SPEC=$1/mouth_features.txt
 	echo "Running smile data parser from" $PARSER_EXE "on" $SOURCE_DATA
 fi
 
-# create directories for storing data
-mkdir -p smile_input smile_ground
-
-# clean out directories
-rm -rf smile_input/*
-rm -rf smile_ground/*
-
-# split the data to input and ground truth data for keras
-$PARSER_EXE -d $SOURCE_DATA -q $Q_IN -o smile_input/
-$PARSER_EXE -d $SOURCE_DATA -q $Q_GT -o smile_ground/
-
-# convert data to canonical space
-$PARSER_EXE -c -ci smile_input/ -cg smile_ground/
-
-# combine data into csv file for python script
-[ ! -e all_canonical_input.csv ] || rm all_canonical_input.csv
-cat smile_input/*_canon.csv >> all_canonical_input.csv
-[ ! -e all_canonical_ground.csv ] || rm all_canonical_ground.csv
-cat smile_ground/*_canon.csv >> all_canonical_ground.csv
-
-# add pre-conversion step to format input data
-python3 format_mouth_data.py -f all_canonical_input.csv
-
-# remove out directories
-rm -rf smile_input
-rm -rf smile_ground
\ No newline at end of file
+# raw data -> queried columns -> canonical space -> mouth features, written
+# straight to all_canonical_input.csv & all_canonical_ground.csv (1 pass, no
+# intermediate files; add -k w/ -o after each -q to keep them)
+$PARSER_EXE -d $SOURCE_DATA -q $Q_IN -q $Q_GT -fs $F_SPEC -F .
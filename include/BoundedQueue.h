@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+/**
+ * \brief Bounded lock-free multi-producer/multi-consumer ring queue (Vyukov).
+ * Each cell carries a sequence number so producers & consumers only contend
+ * on their own end. Capacity is rounded up to a power of 2. T should be cheap
+ * to copy (e.g. a pointer to a batch). Depth is sampled on every push & waits
+ * on a full/empty queue are counted so stages can be balanced
+ */
+template <typename T>
+class BoundedQueue {
+ public:
+  /** \brief producers: number of producerDone() calls that close the queue */
+  BoundedQueue(const char *name, const size_t capacity,
+               const unsigned producers = 1)
+      : name(name),
+        mask(round_pow2(capacity) - 1),
+        cells(new Cell[mask + 1]),
+        enqueue_pos(0),
+        dequeue_pos(0),
+        open_producers(producers),
+        pushes(0),
+        depth_sum(0),
+        max_depth(0),
+        full_waits(0),
+        empty_waits(0) {
+    for (size_t i = 0; i <= mask; i++) cells[i].seq.store(i);
+  }
+
+  /** \brief Add value if there is room. Returns false if full */
+  bool tryPush(const T &val) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[pos & mask];
+      const size_t seq = cell.seq.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          cell.val = val;
+          cell.seq.store(pos + 1, std::memory_order_release);
+          sample(pos + 1);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /** \brief Take oldest value if any. Returns false if empty */
+  bool tryPop(T &val) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell &cell = cells[pos & mask];
+      const size_t seq = cell.seq.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          val = cell.val;
+          cell.seq.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /** \brief Add value, yielding while the queue is full (back pressure) */
+  void push(const T &val) {
+    if (tryPush(val)) return;
+    full_waits++;
+    while (!tryPush(val)) std::this_thread::yield();
+  }
+
+  /**
+   * \brief Take oldest value, yielding while empty. Returns false once every
+   * producer is done & the queue is drained
+   */
+  bool pop(T &val) {
+    if (tryPop(val)) return true;
+    empty_waits++;
+    for (;;) {
+      const bool closed = open_producers.load(std::memory_order_acquire) == 0;
+      if (tryPop(val)) return true;
+      if (closed) return false;
+      std::this_thread::yield();
+    }
+  }
+
+  /** \brief Called by each producer when it has pushed its last value */
+  void producerDone() { open_producers--; }
+
+  /** \brief Print depth & wait counts */
+  void report() const {
+    const size_t count = pushes.load();
+    printf("  %-18s avg depth %.2f / max %zu (cap %zu), full waits %zu, "
+           "empty waits %zu\n",
+           name, count > 0 ? (double)depth_sum.load() / count : 0.0,
+           max_depth.load(), mask + 1, full_waits.load(), empty_waits.load());
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T val;
+  };
+
+  static size_t round_pow2(const size_t val) {
+    size_t pow2 = 2;
+    while (pow2 < val) pow2 <<= 1;
+    return pow2;
+  }
+
+  /** \brief Record queue depth right after a push */
+  void sample(const size_t enqueued) {
+    const size_t dequeued = dequeue_pos.load(std::memory_order_relaxed);
+    const size_t depth = enqueued > dequeued ? enqueued - dequeued : 0;
+    pushes.fetch_add(1, std::memory_order_relaxed);
+    depth_sum.fetch_add(depth, std::memory_order_relaxed);
+    size_t prev = max_depth.load(std::memory_order_relaxed);
+    while (depth > prev && !max_depth.compare_exchange_weak(prev, depth)) {
+    }
+  }
+
+  const char *name;
+  const size_t mask;
+  std::unique_ptr<Cell[]> cells;
+  // producer & consumer ends on separate cache lines
+  alignas(64) std::atomic<size_t> enqueue_pos;
+  alignas(64) std::atomic<size_t> dequeue_pos;
+  alignas(64) std::atomic<unsigned> open_producers;
+  std::atomic<size_t> pushes, depth_sum, max_depth;
+  std::atomic<size_t> full_waits, empty_waits;
+
+  // non-copyable
+  BoundedQueue(const BoundedQueue &);
+  BoundedQueue &operator=(const BoundedQueue &);
+};
+
+/** \brief Accumulates busy time of a pipeline stage (all of its threads) */
+struct StageClock {
+  StageClock(const char *name, const unsigned threads)
+      : name(name), threads(threads), busy_us(0) {}
+
+  /** \brief Print busy time */
+  void report() const {
+    printf("  %-18s %u thread(s), busy %.1f ms\n", name, threads,
+           busy_us.load() / 1000.0);
+  }
+
+  const char *name;
+  unsigned threads;
+  std::atomic<uint64_t> busy_us;
+};
+
+/** \brief Adds the time it is alive to a stage's busy time */
+struct StageTimer {
+  explicit StageTimer(StageClock &clock)
+      : clock(clock), start(std::chrono::steady_clock::now()) {}
+  ~StageTimer() {
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    clock.busy_us += (uint64_t)std::chrono::duration_cast<
+                         std::chrono::microseconds>(elapsed)
+                         .count();
+  }
+
+  StageClock &clock;
+  std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "CanonicalParse.h"
+
+/**
+ * \brief Apply each frame's affine (xforms[frame]) to every landmark of frames
+ * [first, last) of a session. out must be sized like in (may be the same
+ * store). Uses AVX2 or SSE2 when the CPU supports it, scalar code otherwise
+ */
+void apply_session_affine(const Affine2D *xforms, const FrameStore &in,
+                          FrameStore &out, const size_t first,
+                          const size_t last);
+
+/** \brief Name of the instruction set apply_session_affine dispatches to */
+const char *session_kernel_isa();
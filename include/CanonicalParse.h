@@ -2,29 +2,192 @@
 
 #include <glm/glm.hpp>
 #include <vector>
+#include "LandmarkSchema.h"
 #include "NormalParse.h"
 #include "StringLib.h"
-#include <map>
+
+struct FeatureProgram;
+
+/**
+ * \brief Columnar landmark store for a session. x & y are planar & frame-major
+ * ([frame * num_landmarks + landmark]) so a frame is 2 contiguous runs and the
+ * whole session is 2 contiguous (64 byte aligned) arrays. Time stamps are
+ * kept in a parallel array (empty if file has no time column)
+ */
+struct FrameStore {
+  FrameStore() : num_landmarks(0), num_frames(0) {}
+
+  /** \brief Clear frames, set landmark count & reserve room for frames */
+  void reset(const unsigned landmarks, const size_t frames_hint = 0) {
+    num_landmarks = landmarks;
+    num_frames = 0;
+    x.clear();
+    y.clear();
+    time.clear();
+    x.reserve(frames_hint * landmarks);
+    y.reserve(frames_hint * landmarks);
+  }
+
+  /** \brief Size store to frames x landmarks (contents unspecified) */
+  void resize(const unsigned landmarks, const size_t frames) {
+    num_landmarks = landmarks;
+    num_frames = frames;
+    x.resize(frames * landmarks, dd_no_init);
+    y.resize(frames * landmarks, dd_no_init);
+  }
+
+  /** \brief Append a zeroed frame (grows geometrically). Returns its index */
+  size_t addFrame() {
+    x.resize(x.size() + num_landmarks);
+    y.resize(y.size() + num_landmarks);
+    return num_frames++;
+  }
+
+  /** \brief Append all frames of other (same landmark count) */
+  void append(const FrameStore &other) {
+    POW2_VERIFY_MSG(other.num_landmarks == num_landmarks,
+                    "Landmark count mismatch", 0);
+    x.append(other.x.data(), other.x.size());
+    y.append(other.y.data(), other.y.size());
+    time.append(other.time.data(), other.time.size());
+    num_frames += other.num_frames;
+  }
+
+  /** \brief x values of every landmark in frame */
+  inline float *xs(const size_t frame) {
+    return x.data() + frame * num_landmarks;
+  }
+  inline const float *xs(const size_t frame) const {
+    return x.data() + frame * num_landmarks;
+  }
+  /** \brief y values of every landmark in frame */
+  inline float *ys(const size_t frame) {
+    return y.data() + frame * num_landmarks;
+  }
+  inline const float *ys(const size_t frame) const {
+    return y.data() + frame * num_landmarks;
+  }
+
+  /** \brief Position of landmark in frame */
+  inline glm::vec2 get(const size_t frame, const unsigned landmark) const {
+    DD_ACCESS_CHECK(landmark < num_landmarks, "Landmark out of bounds");
+    const size_t idx = frame * num_landmarks + landmark;
+    return glm::vec2(x[idx], y[idx]);
+  }
+
+  inline size_t numFrames() const { return num_frames; }
+  inline unsigned numLandmarks() const { return num_landmarks; }
+
+  dd_array<float> x, y;
+  dd_array<float> time;
+
+ private:
+  unsigned num_landmarks;
+  size_t num_frames;
+};
 
 /** \brief Data struct for csv file information */
 struct SmileData {
-  std::vector<dd_array<glm::vec2>> input_data;
-  std::vector<dd_array<glm::vec2>> ground_data;
-  std::map<cbuff<64>, unsigned> i_keys;
-  std::map<cbuff<64>, unsigned> gt_keys;
-	std::vector<float> time_stamps_i;
-	std::vector<float> time_stamps_gt;
+  FrameStore input_data;
+  FrameStore ground_data;
+  LandmarkIndex i_index;
+  LandmarkIndex gt_index;
 };
 
 enum VecType { INPUT, OUTPUT };
 
+/**
+ * \brief 2x3 affine transform evaluated about a pivot: p' = M * (p - pivot) + t
+ * (M is row-major). Same transform as M * p + (t - M * pivot), but keeps the
+ * large capture coordinates from cancelling in float precision
+ */
+struct Affine2D {
+  float m00, m01, m10, m11;
+  float px, py;
+  float tx, ty;
+};
+
+/**
+ * \brief Compose a frame's canonical transform (translate right lateral
+ * canthus to origin, rotate so the left one lies on +x, scale canthus distance
+ * to iris_dist, translate to iris_pos) into a single affine
+ */
+Affine2D canonical_affine(const glm::vec2 canthus_r, const glm::vec2 canthus_l,
+                          const glm::vec2 iris_pos, const float iris_dist);
+
+/**
+ * \brief Apply affine to n planar points in a single pass. Output goes to
+ * caller-provided storage (may alias the input)
+ */
+void apply_affine(const Affine2D &xf, const float *x, const float *y,
+                  const unsigned n, float *out_x, float *out_y);
+
+/**
+ * \brief Writer session for a pair of input/ground truth canonical files. Each
+ * file is opened once & rows are buffered then flushed w/ large writes. A
+ * memory writer formats a range of frames to be appended to a file writer
+ */
+struct CanonWriter {
+  CanonWriter(const unsigned decimals = 6, const size_t buffer_size = 1 << 20)
+      : i_out(buffer_size),
+        g_out(buffer_size),
+        f_out(buffer_size),
+        decimals(decimals) {}
+
+  /** \brief Open (truncate) both output files */
+  bool open(const std::string &in_name, const std::string &gt_name);
+  /** \brief Keep rows of all 3 outputs in memory */
+  void openMemory();
+  /** \brief Append rows of a memory writer to the open outputs */
+  void append(const CanonWriter &rows);
+  /** \brief Flush & close all files */
+  void close();
+  /** \brief Format a frame as a space separated row (time stamp optional) */
+  void writeRow(ddFileWriter &out, const float *time, const float *x,
+                const float *y, const unsigned n);
+
+  ddFileWriter i_out, g_out, f_out;
+  unsigned decimals;
+};
+
 /** \brief Convert file into canonical space */
 void create_canonical_verts(Args args);
 
-/** \brief Export data into calibrated space by folder */
+/**
+ * \brief Export data into calibrated space by folder. If features is set, it
+ * is evaluated on the canonical data of each session (<id>_feat.csv in
+ * input_dir). File pairs & frame ranges of big sessions run on a
+ * work-stealing pool of threads (logs are printed in file order). W/ pipeline,
+ * loading, transforms & formatting run as separate stages instead
+ */
 void export_canonical(const char *input_dir, const char *ground_dir,
                       const glm::vec2 canonical_iris_pos,
-                      const float canonical_iris_dist);
+                      const float canonical_iris_dist,
+                      const unsigned decimals = 6,
+                      const FeatureProgram *features = nullptr,
+                      const unsigned threads = 1, const bool pipeline = false);
+
+/**
+ * \brief Fused conversion of raw csvs in args.input_dir: rows are projected w/
+ * the 1st (input) & 2nd (ground truth) query sets, moved to canonical space &
+ * run thru the feature spec in memory, then appended in file order to
+ * all_canonical_input.csv (features if a spec is set) &
+ * all_canonical_ground.csv in args.fused_dir. Per-file csvs are only written
+ * w/ args.keep_intermediate
+ */
+void create_fused_dataset(Args args);
+
+/**
+ * \brief Resolve the header fields of a vector file into a landmark -> store
+ * index table (from each "<landmark> x" field, time column excluded). Returns
+ * number of landmarks
+ */
+unsigned vector_index(const std::vector<cview> &fields, LandmarkIndex &index,
+                      bool &time_flag);
 
-/** \brief Get vector of xyz values from input file */
-void extract_vector2(const char *in_file, const VecType type, SmileData& sdata);
+/**
+ * \brief Get vector of xyz values from input file (console output to log).
+ * Large files are parsed in newline-aligned chunks on up to threads threads
+ */
+void extract_vector2(const char *in_file, const VecType type, SmileData& sdata,
+                     JobLog *log = nullptr, const unsigned threads = 1);
@@ -4,8 +4,22 @@
 #ifdef DAYDREAM_CONTAINERS
 
 #include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
 #include "Pow2Assert.h"
+#ifdef WIN32
+#include <malloc.h>
+#endif  // WIN32
+// opt-in: libstdc++'s <execution> needs TBB at link time
+#if defined(DD_EXECUTION) && __cplusplus >= 201703L
+#include <execution>
+#endif
 
 /*
 * Copyright (c) 2016, Moses Adeagbo
@@ -14,92 +28,442 @@
 
 /** @file */
 
-/** \brief Simple array container used for DayDream engine */
+/** \brief Alignment of dd container storage (a cache line, any SIMD load) */
+const size_t dd_align = 64;
+
+/** \brief Tag to construct/resize a container of a trivial type w/o zeroing */
+struct dd_no_init_t {};
+const dd_no_init_t dd_no_init = {};
+
+/** \brief Heap block aligned to dd_align (null on failure) */
+inline void* dd_aligned_alloc(const size_t bytes) {
+#ifdef WIN32
+  return _aligned_malloc(bytes, dd_align);
+#else
+  void* ptr = nullptr;
+  return posix_memalign(&ptr, dd_align, bytes) == 0 ? ptr : nullptr;
+#endif  // WIN32
+}
+
+/** \brief Free a block from dd_aligned_alloc */
+inline void dd_aligned_free(void* ptr) {
+#ifdef WIN32
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif  // WIN32
+}
+
+/**
+ * \brief Element access policy. Checked (default w/o NDEBUG, i.e. Debug
+ * builds) bounds checks every operator[] & GetElement. Unchecked (Release)
+ * leaves single element access bare so loops over it vectorize. Ranges (span,
+ * subspan, row, column views) are checked once either way, so hot loops check
+ * their range up front & index w/o checks. Override w/ -DDD_CHECKED_ACCESS=0/1
+ */
+#ifndef DD_CHECKED_ACCESS
+#ifdef NDEBUG
+#define DD_CHECKED_ACCESS 0
+#else
+#define DD_CHECKED_ACCESS 1
+#endif  // NDEBUG
+#endif  // DD_CHECKED_ACCESS
+
+#if DD_CHECKED_ACCESS
+#define DD_ACCESS_CHECK(cond, msg) POW2_VERIFY_MSG(cond, msg, 0)
+#else
+#define DD_ACCESS_CHECK(cond, msg) \
+  do {                             \
+  } while (0)
+#endif  // DD_CHECKED_ACCESS
+
+/**
+ * \brief Non-owning view of contiguous elements (a dd_array, a dd_2Darray row
+ * or any pointer range). Iterators are plain pointers
+ */
 template <class T>
-class dd_array {
+struct dd_span {
+  typedef T value_type;
+  typedef T* iterator;
+
+  dd_span(T* ptr = nullptr, const size_t len = 0) : ptr(ptr), len(len) {}
+
+  inline T* begin() const { return ptr; }
+  inline T* end() const { return ptr + len; }
+  inline T* data() const { return ptr; }
+  inline size_t size() const { return len; }
+  inline bool empty() const { return len == 0; }
+
+  T& operator[](const size_t idx) const {
+    DD_ACCESS_CHECK(idx < len, "Index out of bounds :: span");
+    return ptr[idx];
+  }
+
+  /** \brief View of count elements starting at first */
+  dd_span subspan(const size_t first, const size_t count) const {
+    POW2_VERIFY_MSG(first + count <= len, "Subspan out of bounds", 0);
+    return dd_span(ptr + first, count);
+  }
+
+  T* ptr;
+  size_t len;
+};
+
+/**
+ * \brief Random-access iterator over every stride-th element (e.g. a column of
+ * a row-major array or 1 landmark of frame-major data)
+ */
+template <class T>
+class dd_stride_iterator {
  public:
-  // ctor
-  dd_array(const size_t size = 0) : _size(size) {
-    if (size != 0) {
-      m_data = new T[size]();
-      POW2_VERIFY_MSG(m_data != nullptr, "New operator failed :: 1D", 0);
-    } else {
-      m_data = nullptr;
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef typename std::remove_const<T>::type value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef T* pointer;
+  typedef T& reference;
+
+  dd_stride_iterator(T* ptr = nullptr, const std::ptrdiff_t stride = 1)
+      : ptr(ptr), stride(stride) {}
+
+  inline T& operator*() const { return *ptr; }
+  inline T* operator->() const { return ptr; }
+  inline T& operator[](const std::ptrdiff_t n) const { return ptr[n * stride]; }
+
+  inline dd_stride_iterator& operator++() {
+    ptr += stride;
+    return *this;
+  }
+  inline dd_stride_iterator operator++(int) {
+    dd_stride_iterator prev = *this;
+    ptr += stride;
+    return prev;
+  }
+  inline dd_stride_iterator& operator--() {
+    ptr -= stride;
+    return *this;
+  }
+  inline dd_stride_iterator operator--(int) {
+    dd_stride_iterator prev = *this;
+    ptr -= stride;
+    return prev;
+  }
+  inline dd_stride_iterator& operator+=(const std::ptrdiff_t n) {
+    ptr += n * stride;
+    return *this;
+  }
+  inline dd_stride_iterator& operator-=(const std::ptrdiff_t n) {
+    ptr -= n * stride;
+    return *this;
+  }
+  inline dd_stride_iterator operator+(const std::ptrdiff_t n) const {
+    return dd_stride_iterator(ptr + n * stride, stride);
+  }
+  inline dd_stride_iterator operator-(const std::ptrdiff_t n) const {
+    return dd_stride_iterator(ptr - n * stride, stride);
+  }
+  inline std::ptrdiff_t operator-(const dd_stride_iterator& other) const {
+    return (ptr - other.ptr) / stride;
+  }
+
+  inline bool operator==(const dd_stride_iterator& o) const {
+    return ptr == o.ptr;
+  }
+  inline bool operator!=(const dd_stride_iterator& o) const {
+    return ptr != o.ptr;
+  }
+  inline bool operator<(const dd_stride_iterator& o) const {
+    return ptr < o.ptr;
+  }
+  inline bool operator>(const dd_stride_iterator& o) const {
+    return ptr > o.ptr;
+  }
+  inline bool operator<=(const dd_stride_iterator& o) const {
+    return ptr <= o.ptr;
+  }
+  inline bool operator>=(const dd_stride_iterator& o) const {
+    return ptr >= o.ptr;
+  }
+
+ private:
+  T* ptr;
+  std::ptrdiff_t stride;
+};
+
+template <class T>
+inline dd_stride_iterator<T> operator+(const std::ptrdiff_t n,
+                                       const dd_stride_iterator<T>& it) {
+  return it + n;
+}
+
+/**
+ * \brief std::transform w/ the unsequenced (SIMD) execution policy when built
+ * w/ DD_EXECUTION & a standard library that has it (C++20 <execution>), plain
+ * std::transform otherwise. Callers already run on pool threads, so loops are
+ * not split across threads again
+ */
+template <class In, class Out, class Op>
+inline Out dd_transform(In first, In last, Out out, Op op) {
+#if defined(__cpp_lib_execution) && __cpp_lib_execution >= 201902L
+  return std::transform(std::execution::unseq, first, last, out, op);
+#else
+  return std::transform(first, last, out, op);
+#endif
+}
+
+/** \brief Binary dd_transform (out[i] = op(first1[i], first2[i])) */
+template <class In1, class In2, class Out, class Op>
+inline Out dd_transform(In1 first1, In1 last1, In2 first2, Out out, Op op) {
+#if defined(__cpp_lib_execution) && __cpp_lib_execution >= 201902L
+  return std::transform(std::execution::unseq, first1, last1, first2, out, op);
+#else
+  return std::transform(first1, last1, first2, out, op);
+#endif
+}
+
+/**
+ * \brief Bump allocator for scratch memory (per file/batch). Allocations are
+ * carved from large blocks & all freed at once by reset(). Blocks are merged
+ * on reset, so a workload that repeats stops calling the heap after its first
+ * pass. Not thread-safe (use 1 per thread)
+ */
+class dd_arena {
+ public:
+  explicit dd_arena(const size_t block_size = 1 << 16)
+      : block_size(block_size), used(0), heap_calls(0) {}
+  ~dd_arena() { release(); }
+
+  /** \brief Get bytes aligned to align (power of 2) */
+  void* allocate(const size_t bytes, const size_t align) {
+    uintptr_t ptr = 0;
+    if (!blocks.empty()) {
+      const uintptr_t base = (uintptr_t)blocks.back().data;
+      ptr = (base + used + align - 1) & ~(uintptr_t)(align - 1);
+      if (ptr + bytes > base + blocks.back().size) ptr = 0;
     }
+    if (ptr == 0) {
+      addBlock(std::max(block_size, bytes + align));
+      const uintptr_t base = (uintptr_t)blocks.back().data;
+      ptr = (base + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    used = ptr + bytes - (uintptr_t)blocks.back().data;
+    return (void*)ptr;
   }
-  // dtor
-  ~dd_array() {
-    if (_size > 0) {
-      delete[] m_data;
+
+  /** \brief Free every allocation (keeps 1 block big enough for all of them) */
+  void reset() {
+    if (blocks.size() > 1) {
+      size_t total = 0;
+      for (auto& block : blocks) total += block.size;
+      release();
+      addBlock(total);
+    }
+    used = 0;
+  }
+
+  /** \brief Bytes reserved from the heap */
+  size_t capacity() const {
+    size_t total = 0;
+    for (auto& block : blocks) total += block.size;
+    return total;
+  }
+  /** \brief Number of blocks requested from the heap so far */
+  inline size_t heapCalls() const { return heap_calls; }
+
+ private:
+  struct Block {
+    char* data;
+    size_t size;
+  };
+
+  void addBlock(const size_t size) {
+    blocks.push_back({new char[size], size});
+    POW2_VERIFY_MSG(blocks.back().data != nullptr, "Arena block failed", 0);
+    used = 0;
+    heap_calls++;
+  }
+
+  void release() {
+    for (auto& block : blocks) delete[] block.data;
+    blocks.clear();
+    used = 0;
+  }
+
+  std::vector<Block> blocks;
+  size_t block_size, used, heap_calls;
+
+  // non-copyable
+  dd_arena(const dd_arena&);
+  dd_arena& operator=(const dd_arena&);
+};
+
+/**
+ * \brief Storage of dd containers: dd_align aligned blocks from the heap or an
+ * arena. Elements are constructed in place (value-initialized unless init is
+ * false) & destroyed on release (arena memory is freed by the arena's reset)
+ */
+template <class T>
+struct _dd_storage {
+  static T* allocate(const size_t size, dd_arena* arena,
+                     const bool init = true) {
+    if (size == 0) return nullptr;
+    const size_t bytes = size * sizeof(T);
+    T* data = static_cast<T*>(arena ? arena->allocate(bytes, dd_align)
+                                    : dd_aligned_alloc(bytes));
+    if (data && init) {
+      for (size_t i = 0; i < size; i++) new (data + i) T();
     }
+    return data;
+  }
+
+  static void release(T* data, const size_t size, dd_arena* arena) {
+    if (!data) return;
+    for (size_t i = 0; i < size; i++) data[i].~T();
+    if (!arena) dd_aligned_free(data);
   }
+};
+
+/**
+ * \brief Simple array container used for DayDream engine. Storage is aligned
+ * to dd_align & grows geometrically (capacity doubles) when appending, moving
+ * elements to the new block. If an arena is set, storage is scratch from the
+ * arena (must be destroyed or moved before the arena is reset). Copies are
+ * always on the heap
+ */
+template <class T>
+class dd_array {
+ public:
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+
+  // ctor
+  dd_array(const size_t size = 0, dd_arena* arena = nullptr)
+      : _size(size), _capacity(size), m_arena(arena) {
+    m_data = _dd_storage<T>::allocate(size, m_arena);
+    POW2_VERIFY_MSG(size == 0 || m_data != nullptr,
+                    "New operator failed :: 1D", 0);
+  }
+  // ctor w/o zeroing elements (trivial types, for buffers overwritten next)
+  dd_array(const size_t size, dd_no_init_t, dd_arena* arena = nullptr)
+      : _size(size), _capacity(size), m_arena(arena) {
+    static_assert(std::is_trivial<T>::value, "dd_no_init needs a trivial T");
+    m_data = _dd_storage<T>::allocate(size, m_arena, false);
+    POW2_VERIFY_MSG(size == 0 || m_data != nullptr,
+                    "New operator failed :: 1D", 0);
+  }
+  // dtor
+  ~dd_array() { _dd_storage<T>::release(m_data, _size, m_arena); }
   // copy ctor
   dd_array(const dd_array& other)
-      : _size(other._size), m_data(new T[other._size]()) {
-    std::copy(other.m_data, other.m_data + _size, m_data);
+      : _size(0), _capacity(0), m_data(nullptr), m_arena(nullptr) {
+    append(other.m_data, other._size);
   }
 
-  // set size
+  // set size (keeps existing elements, new ones are value-initialized)
   bool resize(const size_t size) {
-    if (_size > 0) {
-      delete[] m_data;
-      _size = 0;
-    }
-    if (size != 0) {
-      _size = size;
-      m_data = new T[size]();
-    }
+    grow(size);
+    for (; _size < size; _size++) new (m_data + _size) T();
+    truncate(size);
     return isValid();
   }
+  // set size w/o zeroing new elements (trivial types)
+  bool resize(const size_t size, dd_no_init_t) {
+    static_assert(std::is_trivial<T>::value, "dd_no_init needs a trivial T");
+    grow(size);
+    _size = size;
+    return isValid();
+  }
+
+  // make room for capacity elements (existing elements are moved)
+  void reserve(const size_t capacity) {
+    if (capacity <= _capacity) return;
+    T* data = _dd_storage<T>::allocate(capacity, m_arena, false);
+    POW2_VERIFY_MSG(data != nullptr, "New operator failed :: 1D", 0);
+    for (size_t i = 0; i < _size; i++) new (data + i) T(std::move(m_data[i]));
+    _dd_storage<T>::release(m_data, _size, m_arena);
+    m_data = data;
+    _capacity = capacity;
+  }
+
+  // add element to the end
+  void push_back(const T& val) {
+    if (_size == _capacity) {
+      T copy(val);  // val may live in the block being replaced
+      return push_back(std::move(copy));
+    }
+    new (m_data + _size) T(val);
+    _size++;
+  }
+  void push_back(T&& val) {
+    grow(_size + 1);
+    new (m_data + _size) T(std::move(val));
+    _size++;
+  }
+
+  // add count elements to the end
+  void append(const T* vals, const size_t count) {
+    grow(_size + count);
+    for (size_t i = 0; i < count; i++) new (m_data + _size + i) T(vals[i]);
+    _size += count;
+  }
+
+  // remove all elements (keeps capacity)
+  void clear() { truncate(0); }
+
+  // release unused capacity
+  void shrink_to_fit() {
+    if (_capacity == _size) return;
+    dd_array<T> fitted(0, m_arena);
+    fitted.reserve(_size);
+    for (size_t i = 0; i < _size; i++) fitted.push_back(std::move(m_data[i]));
+    *this = std::move(fitted);
+  }
 
   // returns T from 1D array
   T& operator[](const size_t FirstIndex) {
-    POW2_VERIFY_MSG(FirstIndex < _size, "Index out of bounds :: 1D", 0);
+    DD_ACCESS_CHECK(FirstIndex < _size, "Index out of bounds :: 1D");
     return m_data[FirstIndex];
   }
 
   // returns const T from 1D array
   T& operator[](const size_t FirstIndex) const {
-    POW2_VERIFY_MSG(FirstIndex < _size, "Index out of bounds :: 1D", 0);
+    DD_ACCESS_CHECK(FirstIndex < _size, "Index out of bounds :: 1D");
     return m_data[FirstIndex];
   }
 
-  // copying
-  void operator=(const dd_array& other) {
-    if (other._size == 0) {
-      return;  // nothing in the second array
-    }
-    if (_size == 0) {  // nothing in this array
-      _size = other._size;
-      m_data = new T[_size]();
-    }
-
-    if (_size >= other._size) {  // other array is smaller
-      std::copy(other.m_data, other.m_data + other._size, m_data);
-    } else {  // other array is bigger or equal to this array
-      std::copy(other.m_data, other.m_data + _size, m_data);
+  // copying (this array becomes the same size as other)
+  dd_array& operator=(const dd_array& other) {
+    if (this != &other) {
+      clear();
+      append(other.m_data, other._size);
     }
+    return *this;
   }
 
   // move ctor
-  dd_array(dd_array&& other) : _size(0), m_data(nullptr) {
+  dd_array(dd_array&& other)
+      : _size(0), _capacity(0), m_data(nullptr), m_arena(nullptr) {
     m_data = other.m_data;
     _size = other._size;
+    _capacity = other._capacity;
+    m_arena = other.m_arena;
 
     other.m_data = nullptr;
     other._size = 0;
+    other._capacity = 0;
   }
 
   // move assignment
   dd_array& operator=(dd_array&& other) {
     if (this != &other) {
-      if (m_data != nullptr) {
-        delete[] m_data;
-      }
+      _dd_storage<T>::release(m_data, _size, m_arena);
       m_data = other.m_data;
       _size = other._size;
+      _capacity = other._capacity;
+      m_arena = other.m_arena;
 
       other._size = 0;
+      other._capacity = 0;
       other.m_data = nullptr;
     }
     return *this;
@@ -107,14 +471,42 @@ class dd_array {
 
   // number of elements
   inline size_t size() const { return _size; }
+  // number of elements that fit w/o reallocating
+  inline size_t capacity() const { return _capacity; }
   // size of data in bytes
   inline size_t sizeInBytes() const { return _size * sizeof(T); }
   // checks is data was allocated in memory
   inline bool isValid() const { return (m_data == nullptr) ? false : true; }
+  // raw pointer to the elements (null if empty)
+  inline T* data() const { return m_data; }
+
+  // iterators (plain pointers, no bounds checks)
+  inline T* begin() { return m_data; }
+  inline T* end() { return m_data + _size; }
+  inline const T* begin() const { return m_data; }
+  inline const T* end() const { return m_data + _size; }
+
+  // non-owning view of all (or count elements from first) elements
+  inline dd_span<T> span() const { return dd_span<T>(m_data, _size); }
+  dd_span<T> span(const size_t first, const size_t count) const {
+    POW2_VERIFY_MSG(first + count <= _size, "Span out of bounds :: 1D", 0);
+    return dd_span<T>(m_data + first, count);
+  }
 
  private:
-  size_t _size;
+  // reserve room for size elements (at least doubles capacity)
+  void grow(const size_t size) {
+    if (size > _capacity) reserve(std::max(size, _capacity * 2));
+  }
+
+  // destroy elements past size
+  void truncate(const size_t size) {
+    for (; _size > size; _size--) m_data[_size - 1].~T();
+  }
+
+  size_t _size, _capacity;
   T* m_data;
+  dd_arena* m_arena;
 };
 
 /** \brief Simple 2D-array container used for DayDream engine */
@@ -137,36 +529,34 @@ class dd_2Darray {
     size_t m_firstIndex;
   };
 
-  // ctor
-  dd_2Darray(const size_t Row = 0, const size_t Column = 0)
-      : m_row(Row), m_column(Column) {
-    if (Row != 0 && Column != 0) {
-      m_data = new T[(Row * Column)]();
-      POW2_VERIFY_MSG(m_data != nullptr, "New operator failed :: 1D", 0);
-    } else {
-      m_data = nullptr;
-    }
+  // ctor (storage comes from arena if set)
+  dd_2Darray(const size_t Row = 0, const size_t Column = 0,
+             dd_arena* arena = nullptr)
+      : m_row(Row), m_column(Column), m_arena(arena) {
+    m_data = _dd_storage<T>::allocate(Row * Column, m_arena);
+    POW2_VERIFY_MSG(Row * Column == 0 || m_data != nullptr,
+                    "New operator failed :: 1D", 0);
   }
-  // dtor
-  ~dd_2Darray() {
-    if (isValid()) {
-      delete[] m_data;
-    }
+  // ctor w/o zeroing elements (trivial types, for buffers overwritten next)
+  dd_2Darray(const size_t Row, const size_t Column, dd_no_init_t,
+             dd_arena* arena = nullptr)
+      : m_row(Row), m_column(Column), m_arena(arena) {
+    static_assert(std::is_trivial<T>::value, "dd_no_init needs a trivial T");
+    m_data = _dd_storage<T>::allocate(Row * Column, m_arena, false);
+    POW2_VERIFY_MSG(Row * Column == 0 || m_data != nullptr,
+                    "New operator failed :: 1D", 0);
   }
+  // dtor
+  ~dd_2Darray() { _dd_storage<T>::release(m_data, size(), m_arena); }
 
   // set size
   bool resize(const size_t Row, const size_t Column) {
-    if (isValid()) {
-      m_row = 0;
-      m_column = 0;
-      delete[] m_data;
-    }
-    if (Row != 0 && Column != 0) {
-      m_row = Row;
-      m_column = Column;
-      m_data = new T[(Row * Column)]();
-    }
-    return isValid();
+    return reallocate(Row, Column, true);
+  }
+  // set size w/o zeroing elements (trivial types)
+  bool resize(const size_t Row, const size_t Column, dd_no_init_t) {
+    static_assert(std::is_trivial<T>::value, "dd_no_init needs a trivial T");
+    return reallocate(Row, Column, false);
   }
 
   // Return a proxy object that "knows" to which container it has to ask the
@@ -178,48 +568,37 @@ class dd_2Darray {
 
   // return 2D data
   T& GetElement(size_t FirstIndex, size_t SecondIndex) {
-    POW2_VERIFY_MSG((FirstIndex * m_column + SecondIndex) < (m_column * m_row),
-                    "Index out of bounds :: 2D", 0);
+    DD_ACCESS_CHECK((FirstIndex * m_column + SecondIndex) < (m_column * m_row),
+                    "Index out of bounds :: 2D");
     return m_data[(FirstIndex * m_column) + SecondIndex];
   }
   // return const 2D data
   T& GetElement(size_t FirstIndex, size_t SecondIndex) const {
-    POW2_VERIFY_MSG((FirstIndex * m_column + SecondIndex) < (m_column * m_row),
-                    "Index out of bounds :: 2D", 0);
+    DD_ACCESS_CHECK((FirstIndex * m_column + SecondIndex) < (m_column * m_row),
+                    "Index out of bounds :: 2D");
     return m_data[(FirstIndex * m_column) + SecondIndex];
   }
 
-  // copying
-  void operator=(const dd_2Darray& other) {
-    if (other.m_column == 0 && other.m_row == 0) {
-      return;  // nothing in the second array
-    }
-    if (m_row == 0 && m_column == 0) {  // nothing in this array
+  // copying (this array becomes the same shape as other)
+  dd_2Darray& operator=(const dd_2Darray& other) {
+    if (this != &other) {
+      if (size() != other.size()) {
+        reallocate(other.m_row, other.m_column, true);
+      }
       m_row = other.m_row;
       m_column = other.m_column;
-      m_data = new T[(m_row * m_column)]();
-    }
-
-    if (other.m_column == m_column && other.m_row == m_row) {
-      std::copy(other.m_data, other.m_data + (other.m_row * other.m_column),
-                m_data);
-    } else {
-      const size_t min_row = std::min(other.m_row, m_row);
-      const size_t min_col = std::min(other.m_column, m_column);
-      for (size_t i = 0; i < min_row; i++) {
-        const size_t m_i = i * m_column;
-        const size_t o_i = i * other.m_column;
-        std::copy(other.m_data + o_i, other.m_data + o_i + min_col,
-                  m_data + m_i);
-      }
+      std::copy(other.m_data, other.m_data + other.size(), m_data);
     }
+    return *this;
   }
 
   // move ctor
-  dd_2Darray(dd_2Darray&& other) : m_data(nullptr), m_row(0), m_column(0) {
+  dd_2Darray(dd_2Darray&& other)
+      : m_row(0), m_column(0), m_data(nullptr), m_arena(nullptr) {
     m_data = other.m_data;
     m_row = other.m_row;
     m_column = other.m_column;
+    m_arena = other.m_arena;
 
     other.m_data = nullptr;
     other.m_row = 0;
@@ -229,12 +608,11 @@ class dd_2Darray {
   // move assignment
   dd_2Darray& operator=(dd_2Darray&& other) {
     if (this != &other) {
-      if (m_data != nullptr) {
-        delete[] m_data;
-      }
+      _dd_storage<T>::release(m_data, size(), m_arena);
       m_data = other.m_data;
       m_row = other.m_row;
       m_column = other.m_column;
+      m_arena = other.m_arena;
 
       other.m_data = nullptr;
       other.m_row = 0;
@@ -249,12 +627,44 @@ class dd_2Darray {
   inline size_t sizeInBytes() const { return m_row * m_column * sizeof(T); }
   inline size_t numRows() const { return m_row; }
   inline size_t numColumns() const { return m_column; }
+
+  // iterators over every element (row-major, no bounds checks)
+  inline T* begin() const { return m_data; }
+  inline T* end() const { return m_data + size(); }
+
+  // view of a row
+  dd_span<T> row(const size_t Row) const {
+    POW2_VERIFY_MSG(Row < m_row, "Row out of bounds :: 2D", 0);
+    return dd_span<T>(m_data + Row * m_column, m_column);
+  }
+  // iterators over a column
+  dd_stride_iterator<T> columnBegin(const size_t Column) const {
+    POW2_VERIFY_MSG(Column < m_column, "Column out of bounds :: 2D", 0);
+    return dd_stride_iterator<T>(m_data + Column, m_column);
+  }
+  dd_stride_iterator<T> columnEnd(const size_t Column) const {
+    return columnBegin(Column) + m_row;
+  }
   // checks is data was allocated in memory
   inline bool isValid() const { return (m_data == nullptr) ? false : true; }
 
  private:
+  bool reallocate(const size_t Row, const size_t Column, const bool init) {
+    _dd_storage<T>::release(m_data, size(), m_arena);
+    m_data = nullptr;
+    m_row = 0;
+    m_column = 0;
+    if (Row != 0 && Column != 0) {
+      m_row = Row;
+      m_column = Column;
+      m_data = _dd_storage<T>::allocate(Row * Column, m_arena, init);
+    }
+    return isValid();
+  }
+
   size_t m_row, m_column;
   T* m_data;
+  dd_arena* m_arena;
 };
 
 template <typename T>
@@ -263,10 +673,13 @@ struct _dd_iter {
   T* ptr;
 };
 
-/** A for-each implementation for dd_array objects */
-#define DD_FOREACH(TYPE, VAR, ddARRAY)                                       \
-  for (_dd_iter<TYPE> VAR = {0, ddARRAY.size() > 0 ? &ddARRAY[0] : nullptr}; \
-       VAR.i < ddARRAY.size();                                               \
-       VAR.ptr = ((ddARRAY.size() > ++VAR.i) ? &ddARRAY[VAR.i] : nullptr))
+/**
+ * A for-each implementation for dd_array objects (w/ the index). Plain
+ * range-based for loops work too
+ */
+#define DD_FOREACH(TYPE, VAR, ddARRAY)                                   \
+  for (_dd_iter<TYPE> VAR = {0, ddARRAY.data()}; VAR.i < ddARRAY.size(); \
+       VAR.ptr =                                                         \
+           ((ddARRAY.size() > ++VAR.i) ? ddARRAY.data() + VAR.i : nullptr))
 
 #endif  // !DDAYDREAM_CONTAINERS
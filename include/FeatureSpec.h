@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "CanonicalParse.h"
+
+/**
+ * \brief Derived feature operations. Landmark args are positions (x & y), A
+ * & B of RATIO are previously defined features
+ *   dx(A, B)  dy(A, B)        A - B on one axis
+ *   absdx(A, B)  absdy(A, B)  |A - B| on one axis
+ *   dist(A, B)                euclidean distance
+ *   angle(A, B)               atan2(A.y - B.y, A.x - B.x)
+ *   ratio(A, B)               feature A / feature B
+ *   symmetry(L, R, M)         (|L - M| - |R - M|) / (|L - M| + |R - M|)
+ */
+enum FeatureOp { DX, DY, ABS_DX, ABS_DY, DIST, ANGLE, RATIO, SYMMETRY };
+
+/** \brief Single instruction: computes feature (instruction index) from args */
+struct FeatureInstr {
+  FeatureOp op;
+  unsigned args[3];  // landmark slots (feature indices for RATIO)
+};
+
+/**
+ * \brief Landmark arg of a spec: a schema landmark (bound w/ a table read) or,
+ * if id is NUM_LANDMARKS, a header name looked up per session
+ */
+struct LandmarkSlot {
+  Landmark id;
+  std::string name;
+};
+
+/** \brief Landmark slot bound to a store (0 = input, 1 = ground) & index */
+struct LandmarkRef {
+  unsigned store;
+  unsigned landmark;
+};
+
+/**
+ * \brief Feature spec compiled into a flat instruction list. Spec lines are
+ * "name = op(arg, arg[, arg])" w/ landmark names as args (e.g. "Oral commisure
+ * (L)"), '#' starts a comment. Landmark names are resolved against the
+ * landmark schema (names outside it are kept for a lookup by header name) &
+ * collected into slots that are bound to column indices per session by link()
+ */
+struct FeatureProgram {
+  /** \brief Compile spec text (errors are reported w/ source & line) */
+  bool compile(const cview spec, const char *source);
+  /** \brief Load & compile spec file */
+  bool load(const char *file);
+
+  /** \brief Bind landmark slots to a session's input/ground columns */
+  bool link(const LandmarkIndex &i_index, const LandmarkIndex &gt_index,
+            std::vector<LandmarkRef> &bound) const;
+
+  /**
+   * \brief Run every instruction over frames [first, first + frames). Output
+   * is columnar: columns[feature * frames + frame - first] (resized, so its
+   * storage comes from the columns' arena if set)
+   */
+  void evaluate(const std::vector<LandmarkRef> &bound,
+                const FrameStore &input, const FrameStore &ground,
+                const size_t first, const size_t frames,
+                dd_array<float> &columns) const;
+
+  /** \brief Write evaluated features as space separated rows */
+  void write(const dd_array<float> &columns, const size_t frames,
+             ddFileWriter &out, const unsigned decimals) const;
+
+  std::vector<std::string> names;
+  std::vector<FeatureInstr> code;
+  std::vector<LandmarkSlot> landmarks;
+};
+
+/** \brief Spec of the mouth features (width, dental show, smile angle) */
+const char *mouth_feature_spec();
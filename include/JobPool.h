@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** \brief Console output of a job (buffered so jobs can print in order) */
+struct JobLog {
+  /** \brief Append printf formatted text */
+  void post(const char *fmt, ...);
+  /** \brief Print & clear buffered text */
+  void flush();
+
+  std::string text;
+};
+
+/** \brief Post to log if set, else print straight to the console */
+void job_post(JobLog *log, const char *fmt, ...);
+
+/** \brief Number of worker threads for a -j value (0 = all cores) */
+unsigned job_threads(const unsigned requested);
+
+/**
+ * \brief Calls finish once per job in index order as soon as the job & every
+ * job before it are done. done() may be called from any thread (finish calls
+ * never overlap, so finish can safely print or touch shared state)
+ */
+class JobRetirer {
+ public:
+  JobRetirer(const unsigned count, std::function<void(unsigned)> finish)
+      : finish(finish), completed(count, 0), retired(0) {}
+
+  /** \brief Mark job as done & retire every finished job in order */
+  void done(const unsigned idx);
+
+ private:
+  std::function<void(unsigned)> finish;
+  std::vector<char> completed;
+  unsigned retired;
+  std::mutex lock;
+};
+
+/**
+ * \brief Run count independent jobs on a pool of threads. Jobs are started in
+ * schedule order (e.g. largest first) & retired in index order by finish (see
+ * JobRetirer). W/ 1 thread jobs run inline in index order
+ */
+void run_jobs(const unsigned count, const unsigned threads,
+              const std::vector<unsigned> &schedule,
+              const std::function<void(unsigned)> &job,
+              const std::function<void(unsigned)> &finish);
+
+/**
+ * \brief Run jobs over a stream of inputs w/ at most window of them in flight.
+ * fetch(slot) loads the next input into slot (false once there are none),
+ * job(slot) runs on a pool of threads & finish(slot) retires inputs in fetch
+ * order (fetch & finish calls never overlap). A slot is reused only after its
+ * input is retired, so memory is bounded by window & not by the stream. W/ 1
+ * thread each input is fetched, run & retired inline in slot 0
+ */
+void run_window(const unsigned threads, const unsigned window,
+                const std::function<bool(unsigned)> &fetch,
+                const std::function<void(unsigned)> &job,
+                const std::function<void(unsigned)> &finish);
+
+/**
+ * \brief Work-stealing task scheduler. Workers push & pop tasks at the back of
+ * their own deque (newest first, so split work stays hot in cache) & steal
+ * from the front of other deques when they run dry. Each deque has its own
+ * lock, which is only contended when it is stolen from. Workers w/ nothing to
+ * pop or steal sleep until a task is spawned or every task is done
+ */
+class TaskPool {
+ public:
+  typedef std::function<void()> Task;
+
+  explicit TaskPool(const unsigned threads);
+
+  /**
+   * \brief Queue task. Inside run() it goes on the calling worker's deque,
+   * before run() deques are filled round-robin
+   */
+  void spawn(Task task);
+
+  /** \brief Run until every task (including ones spawned by tasks) is done */
+  void run();
+
+ private:
+  struct Worker {
+    std::mutex lock;
+    std::deque<Task> tasks;
+  };
+
+  /** \brief Take newest task of worker w */
+  bool pop(const unsigned w, Task &task);
+  /** \brief Take oldest task of any other worker */
+  bool steal(const unsigned w, Task &task);
+  /** \brief Worker loop (exits when no task is pending) */
+  void work(const unsigned w);
+  /** \brief Wake idle workers (1 for a new task, all once work is done) */
+  void wake(const bool all);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<size_t> pending;  // spawned & not finished
+  std::atomic<size_t> queued;   // spawned & not yet taken by a worker
+  unsigned next_worker;
+  std::mutex idle_lock;
+  std::condition_variable idle;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <string.h>
+#include <map>
+#include <string>
+#include "StringLib.h"
+
+/** \brief Landmarks of the capture files (face_points.txt order) */
+enum Landmark {
+  ORAL_COMMISURE_L,
+  ORAL_COMMISURE_R,
+  LATERAL_CANTHUS_L,
+  LATERAL_CANTHUS_R,
+  PALPEBRAL_FISSURE_RU,
+  PALPEBRAL_FISSURE_RL,
+  PALPEBRAL_FISSURE_LU,
+  PALPEBRAL_FISSURE_LL,
+  DEPRESSOR_L,
+  DEPRESSOR_R,
+  DEPRESSOR_M,
+  IRIS_M,
+  IRIS_L,
+  NASAL_ALA_L,
+  NASAL_ALA_R,
+  MEDIAL_BROW_L,
+  MEDIAL_BROW_R,
+  MALAR_EMINENCE_L,
+  MALAR_EMINENCE_R,
+  DENTAL_SHOW_TOP,
+  DENTAL_SHOW_BOTTOM,
+  NUM_LANDMARKS
+};
+
+/** \brief Header name of each landmark (its columns are "<name> x/y") */
+constexpr const char *landmark_names[NUM_LANDMARKS] = {
+    "Oral commisure (L)",     "Oral commisure (R)",
+    "Lateral canthus (L)",    "Lateral canthus (R)",
+    "Palpebral fissure (RU)", "Palpebral fissure (RL)",
+    "Palpebral fissure (LU)", "Palpebral fissure (LL)",
+    "Depressor (L)",          "Depressor (R)",
+    "Depressor (M)",          "Iris (M)",
+    "Iris (L)",               "Nasal ala (L)",
+    "Nasal ala (R)",          "Medial brow (L)",
+    "Medial brow (R)",        "Malar eminence (L)",
+    "Malar eminence (R)",     "Dental show (Top)",
+    "Dental show (Bottom)",
+};
+
+/** \brief Store index of a landmark missing from a file */
+constexpr unsigned landmark_absent = ~0u;
+
+namespace LandmarkSpace {
+/** \brief Number of perfect hash buckets (smallest w/o collisions) */
+constexpr unsigned buckets = 44;
+
+/** \brief Compile-time getCharHash */
+constexpr size_t hash(const char *s, const size_t h = 5381) {
+  return *s ? hash(s + 1, ((h << 5) + h) + *s) : h;
+}
+
+/** \brief Perfect hash bucket of a landmark name hash */
+constexpr unsigned bucket(const size_t name_hash) {
+  return (unsigned)(name_hash % buckets);
+}
+
+/** \brief Landmark that hashes to bucket b (NUM_LANDMARKS if empty) */
+constexpr unsigned owner(const unsigned b, const unsigned lm = 0) {
+  return (lm == NUM_LANDMARKS || bucket(hash(landmark_names[lm])) == b)
+             ? lm
+             : owner(b, lm + 1);
+}
+
+/** \brief True if no 2 landmarks share a bucket */
+constexpr bool is_perfect(const unsigned lm = 0) {
+  return lm == NUM_LANDMARKS ||
+         (owner(bucket(hash(landmark_names[lm]))) == lm &&
+          is_perfect(lm + 1));
+}
+static_assert(is_perfect(), "Landmark names collide, change buckets");
+
+/** \brief bucket -> landmark table (built from the names at compile time) */
+template <unsigned... B>
+struct Table {
+  static constexpr unsigned char slot[sizeof...(B)] = {
+      (unsigned char)owner(B)...};
+};
+template <unsigned... B>
+constexpr unsigned char Table<B...>::slot[sizeof...(B)];
+
+template <unsigned N, unsigned... B>
+struct MakeTable : MakeTable<N - 1, N - 1, B...> {};
+template <unsigned... B>
+struct MakeTable<0, B...> : Table<B...> {};
+
+typedef MakeTable<buckets> BucketTable;
+}  // namespace LandmarkSpace
+
+/** \brief Landmark named name (NUM_LANDMARKS if not in the schema) */
+inline Landmark find_landmark(const cview name) {
+  using namespace LandmarkSpace;
+  const unsigned lm = BucketTable::slot[bucket(getCharHash(name))];
+  if (lm == NUM_LANDMARKS || strlen(landmark_names[lm]) != name.len ||
+      strncmp(landmark_names[lm], name.ptr, name.len) != 0) {
+    return NUM_LANDMARKS;
+  }
+  return (Landmark)lm;
+}
+
+/**
+ * \brief Dense landmark -> store index table of a file, resolved once from its
+ * header (landmark_absent for landmarks the file doesn't have). Landmarks
+ * that aren't in the schema keep a slot by header name (looked up by name, so
+ * new landmarks don't need a recompile)
+ */
+struct LandmarkIndex {
+  LandmarkIndex() { clear(); }
+
+  void clear() {
+    for (unsigned &idx : index) idx = landmark_absent;
+    extra.clear();
+  }
+  /** \brief Record the store index of a landmark by its header name */
+  void add(const cview name, const unsigned store_idx) {
+    const Landmark lm = find_landmark(name);
+    if (lm != NUM_LANDMARKS) {
+      index[lm] = store_idx;
+    } else {
+      extra[std::string(name.ptr, name.len)] = store_idx;
+    }
+  }
+  /** \brief Store index of lm */
+  inline unsigned operator[](const Landmark lm) const { return index[lm]; }
+  /** \brief True if the file has lm's columns */
+  inline bool has(const Landmark lm) const {
+    return index[lm] != landmark_absent;
+  }
+  /** \brief Store index of a landmark that isn't in the schema (by name) */
+  unsigned find(const std::string &name) const {
+    auto it = extra.find(name);
+    return it != extra.end() ? it->second : landmark_absent;
+  }
+
+  unsigned index[NUM_LANDMARKS];
+  std::map<std::string, unsigned> extra;  // landmarks not in the schema
+};
@@ -1,10 +1,22 @@
 #pragma once
 
 #include "ddFileIO.h"
+#include "JobPool.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
+/** \brief Queries projected into their own output directory */
+struct QuerySet {
+	std::vector<std::string> queries;
+	std::string output_dir = "";  // empty uses Args::output_dir
+};
+
 struct Args {
 	bool create_canonical = false;
+	bool mouth_features = false;
 	bool help = false;
 	std::string stripped_filename = "";
 	std::string output_dir = "";
@@ -12,16 +24,107 @@ struct Args {
 	std::string input_dir = "";
 	std::string canon_in = "";
 	std::string canon_gt = "";
-	std::vector<std::string> queries;
+	std::string feature_spec = "";
+	unsigned canon_decimals = 6;
+	unsigned jobs = 1;
+	bool pipeline = false;
+	std::vector<QuerySet> query_sets;  // each -q (& its -o) is 1 set
+	std::string fused_dir = "";        // raw -> final datasets in 1 pass
+	bool keep_intermediate = false;    // fused mode also writes per-file csvs
+};
+
+/** \brief Size of a chunk of rows a file is parsed in (a window at a time) */
+const size_t parse_chunk_bytes = 1 << 20;
+/** \brief Size of a batch of rows passed b/t pipeline stages */
+const size_t pipeline_batch_bytes = 1 << 18;
+
+/** \brief Queried columns of a csv header, resolved to field indices */
+struct ColumnPlan {
+	std::vector<unsigned> columns;  // file column of each output column
+	std::vector<unsigned> scan;     // unique file columns (ascending)
+	std::vector<unsigned> slot;     // index into scan for each output column
+};
+
+/** \brief Match queries against header fields to create a column plan */
+ColumnPlan resolve_columns(const cview header,
+                           const std::vector<std::string>& queries);
+
+/**
+ * \brief Column plans of every query set of a header. Plans share 1 scan (the
+ * union of their columns) so a row is tokenized once for all outputs
+ */
+struct ProjectionPlan {
+	std::vector<ColumnPlan> plans;  // 1 per query set (scan is the union)
+	unsigned fields = 0;            // number of header fields
 };
 
-typedef std::vector<std::vector<std::string>> output_data;
+/** \brief Resolve a column plan per query set & merge their scans */
+ProjectionPlan resolve_projection(const cview header,
+                                  const std::vector<QuerySet>& sets);
+
+/**
+ * \brief Caches resolved projection plans by header fingerprint so files that
+ * share a header skip query matching. Safe to share b/t threads. New schemas
+ * are reported once (in the order files are reported, not resolved)
+ */
+struct SchemaCache {
+	/** \brief Return cached plan for header (resolve & cache if new) */
+	const ProjectionPlan& resolve(const cview header,
+	                              const std::vector<QuerySet>& sets);
+
+	/** \brief Print schema change if plan is new (after the 1st schema) */
+	void report(const ProjectionPlan& plan, const char* source);
+
+private:
+	struct Schema {
+		std::string header;
+		ProjectionPlan plan;
+	};
+	std::map<size_t, std::list<Schema>> schemas;  // list keeps plans in place
+	std::vector<const ProjectionPlan*> reported;
+	std::mutex lock;
+};
+
+/** \brief 1 writer per query set */
+typedef std::vector<std::unique_ptr<ddFileWriter>> WriterSet;
+
+/** \brief Writers that keep their output in memory */
+WriterSet memory_writers(const size_t count);
+
+/**
+ * \brief Output file of a query set (<dir>/<args.stripped_filename>_out.csv)
+ */
+std::string output_file(const Args& args, const QuerySet& set);
+
+/**
+ * \brief Write a row already selected w/ the projection's scan as a delimited
+ * row of every query set
+ */
+void write_selected(const ProjectionPlan& projection,
+                    const std::vector<cview>& vals, const char delim,
+                    WriterSet& outs);
 
-/** \brief Parse CSV and extract data row-by-row*/
-output_data parse_csv(const Args& args);
+/**
+ * \brief Stream queried columns of a CSV straight to the output file of each
+ * query set. The file is read & tokenized once for all query sets. W/ 1 job
+ * rows are written one by one, w/ more a window of 2 chunks per job (see
+ * parse_chunk_bytes) is projected in parallel & written in order, so memory
+ * is bounded either way. Console output goes to log if set. Returns the
+ * cached plan used (null w/o schemas or if the file is empty or failed to
+ * open)
+ */
+const ProjectionPlan* stream_csv(const Args& args,
+                                 SchemaCache* schemas = nullptr,
+                                 JobLog* log = nullptr);
 
-/** \brief Output csv file*/
-void write_data(const Args& args, const output_data& data);
+/**
+ * \brief Convert files w/ a staged pipeline: a reader thread maps files &
+ * cuts them into batches of rows, args.jobs parser threads project queried
+ * columns & this thread writes batches in file order. Stages are connected by
+ * bounded lock-free queues, so reads, parsing & writes overlap. Queue depths
+ * & stage busy times are printed at the end
+ */
+void pipeline_csvs(const Args& args, const std::vector<std::string>& files);
 
 /** \brief Extract queries from file */
 std::vector<std::string> extract_queries(const char* file);
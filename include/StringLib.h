@@ -5,8 +5,11 @@
 #pragma once
 
 #include <string.h>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <string>
+#include <vector>
 #include "Container.h"
 
 /** \brief Hashes const char* strings */
@@ -17,6 +20,27 @@ inline size_t getCharHash(const char* s) {
   return h;
 }
 
+/** \brief Non-owning view of a character range (not null-terminated) */
+struct cview {
+  cview() : ptr(nullptr), len(0) {}
+  cview(const char* in_ptr, const size_t in_len) : ptr(in_ptr), len(in_len) {}
+
+  /** \brief Returns true if view points to data */
+  inline bool isValid() const { return ptr != nullptr; }
+  /** \brief Returns pointer one past the last character */
+  inline const char* end() const { return ptr + len; }
+
+  const char* ptr;
+  size_t len;
+};
+
+/** \brief Hashes cview strings (same hash as the const char* version) */
+inline size_t getCharHash(const cview s) {
+  size_t h = 5381;
+  for (const char* c = s.ptr; c < s.end(); c++) h = ((h << 5) + h) + *c;
+  return h;
+}
+
 // small container (8 bytes + T)
 /** \brief A small string manipulation class for char[T] */
 template <const int T>
@@ -47,6 +71,14 @@ struct cbuff {
     hash = getCharHash(cstr);
   }
 
+  /** \brief Sets and hashes internal cstr to in_view (truncated to T - 1) */
+  void set(const cview in_view) {
+    const size_t len = in_view.len < (size_t)T ? in_view.len : (size_t)T - 1;
+    memcpy(cstr, in_view.ptr, len);
+    cstr[len] = '\0';
+    hash = getCharHash(cstr);
+  }
+
   /** \brief Sets and hashes internal cstr using format string */
   template <typename... Args>
   void format(const char* format_str, const Args&... args) {
@@ -64,37 +96,260 @@ struct cbuff {
   size_t hash;
 };
 
-/** \brief Simple operations on cbuff containers */
+/** \brief Simple operations on cbuff containers & cview's */
 namespace StrSpace {
 /**
- * \brief Take a string buffer and return a tokenized cbuff array
- * WARNING: strToSplit will be cut off if greater than 1024 chars
+ * \brief View of the line at cur (w/o its '\n') & move cur to the next line.
+ * An empty line returns a view of length 0
+ */
+inline cview next_line(const char*& cur, const char* end) {
+  const char* nl = (const char*)memchr(cur, '\n', end - cur);
+  const cview line(cur, (nl ? nl : end) - cur);
+  cur = nl ? nl + 1 : end;
+  return line;
+}
+
+/**
+ * \brief Split line into views of each field in a single pass (memchr is
+ * vectorized by the C library). Empty fields are kept in place & no field is
+ * copied or hashed. Returns number of fields
+ */
+inline unsigned tokenize(const cview line, const char delim,
+                         std::vector<cview>& fields) {
+  fields.clear();
+  if (!line.isValid()) return 0;
+
+  const char* start = line.ptr;
+  const char* const end = line.end();
+  while (true) {
+    const char* nxt = (const char*)memchr(start, delim, end - start);
+    if (!nxt) {
+      fields.push_back(cview(start, end - start));
+      break;
+    }
+    fields.push_back(cview(start, nxt - start));
+    start = nxt + 1;
+  }
+  return (unsigned)fields.size();
+}
+
+/**
+ * \brief Extract views of only the fields at idxs (must be ascending) in a
+ * single pass. Scanning stops at the last requested field & fields that are
+ * not requested are skipped w/o being copied. Missing fields are set to empty
+ * views. Returns number of requested fields found
  */
-template <const unsigned T>
-dd_array<cbuff<T>> tokenize1024(const char* strToSplit, const char* delim) {
-  char buff[1024];
-  snprintf(buff, 1024, "%s", strToSplit);
-  dd_array<cbuff<T>> output;
-
-  // count number of delims
-  const char* str_ptr = strToSplit;
-  unsigned numTkns = 0, iter = 0;
-  while (*str_ptr) {
-    if (*str_ptr == *delim) {
-      numTkns += 1;
+inline unsigned select(const cview line, const char delim,
+                       const std::vector<unsigned>& idxs,
+                       std::vector<cview>& fields) {
+  fields.assign(idxs.size(), cview());
+  if (!line.isValid()) return 0;
+
+  const char* start = line.ptr;
+  const char* const end = line.end();
+  unsigned field = 0, found = 0;
+  while (found < idxs.size()) {
+    const char* nxt = (const char*)memchr(start, delim, end - start);
+    if (field == idxs[found]) {
+      fields[found] = cview(start, (nxt ? nxt : end) - start);
+      found++;
     }
-    str_ptr++;
+    if (!nxt) break;
+    start = nxt + 1;
+    field++;
+  }
+  return found;
+}
+
+/**
+ * \brief strtod of the number token at str (up to the 1st ',', ' ', '\t' or
+ * '\n' before end). The token is copied so strtod can't skip past end into
+ * the next field or line. Returns number of chars converted (0 if none)
+ */
+inline size_t bounded_strtod(const char* str, const char* end, double& out) {
+  const char* tok_end = str;
+  while (tok_end < end && *tok_end != ',' && *tok_end != ' ' &&
+         *tok_end != '\t' && *tok_end != '\n') {
+    tok_end++;
   }
-  numTkns += 1;
-  output.resize(numTkns);
-  // copy to array
-  char* nxt = strtok(buff, delim);
+  const size_t len = tok_end - str;
+  char buff[64];
+  std::string big;
+  const char* src = buff;
+  if (len < sizeof(buff)) {
+    memcpy(buff, str, len);
+    buff[len] = '\0';
+  } else {
+    big.assign(str, len);
+    src = big.c_str();
+  }
+  char* nxt = nullptr;
+  out = std::strtod(src, &nxt);
+  return nxt - src;
+}
+
+/**
+ * \brief Parse a decimal float in [str, end) w/o locale lookups. Mantissas of
+ * up to 2^53 w/ a power-of-ten exponent within +/-22 are converted exactly in
+ * double precision (Clinger's fast path) so the result is identical to
+ * (float)strtod. Anything else falls back to a bounded strtod. Returns pointer
+ * past the parsed number or str if nothing was converted
+ */
+inline const char* parse_float(const char* str, const char* end, float& out) {
+  static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                 1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char* curr = str;
+  out = 0.f;
+
+  // skip leading whitespace (bounded, unlike strtod)
+  while (curr < end && (*curr == ' ' || *curr == '\t')) curr++;
+  const char* const num_start = curr;
+
+  bool negative = false;
+  if (curr < end && (*curr == '-' || *curr == '+')) {
+    negative = *curr == '-';
+    curr++;
+  }
+
+  // mantissa digits (up to 19 significant digits fit in 64 bits)
+  unsigned long long mantissa = 0;
+  int num_digits = 0, exp10 = 0;
+  bool any_digits = false;
+  while (curr < end && *curr >= '0' && *curr <= '9') {
+    if (num_digits < 19) {
+      mantissa = mantissa * 10 + (unsigned)(*curr - '0');
+      if (mantissa) num_digits++;
+    } else {
+      exp10++;
+      if (*curr != '0') num_digits++;  // inexact: force slow path
+    }
+    any_digits = true;
+    curr++;
+  }
+  if (curr < end && *curr == '.') {
+    curr++;
+    while (curr < end && *curr >= '0' && *curr <= '9') {
+      if (num_digits < 19) {
+        mantissa = mantissa * 10 + (unsigned)(*curr - '0');
+        if (mantissa) num_digits++;
+        exp10--;
+      } else if (*curr != '0') {
+        num_digits++;  // inexact: force slow path
+      }
+      any_digits = true;
+      curr++;
+    }
+  }
+
+  // hex, inf & nan are left to strtod
+  const bool hex = any_digits && curr < end && (*curr == 'x' || *curr == 'X');
+  if (!any_digits || hex) {
+    double val = 0.0;
+    const size_t len = bounded_strtod(num_start, end, val);
+    if (len == 0) return str;
+    out = (float)val;
+    return num_start + len;
+  }
+
+  // exponent
+  if (curr < end && (*curr == 'e' || *curr == 'E')) {
+    const char* exp_ptr = curr + 1;
+    bool exp_negative = false;
+    if (exp_ptr < end && (*exp_ptr == '-' || *exp_ptr == '+')) {
+      exp_negative = *exp_ptr == '-';
+      exp_ptr++;
+    }
+    if (exp_ptr < end && *exp_ptr >= '0' && *exp_ptr <= '9') {
+      int exp_val = 0;
+      while (exp_ptr < end && *exp_ptr >= '0' && *exp_ptr <= '9') {
+        if (exp_val < 100000) exp_val = exp_val * 10 + (*exp_ptr - '0');
+        exp_ptr++;
+      }
+      exp10 += exp_negative ? -exp_val : exp_val;
+      curr = exp_ptr;
+    }
+  }
+
+  if (num_digits <= 19 && mantissa <= (1ull << 53) && exp10 >= -22 &&
+      exp10 <= 22) {
+    double val = (double)mantissa;
+    val = exp10 < 0 ? val / pow10[-exp10] : val * pow10[exp10];
+    out = (float)(negative ? -val : val);
+  } else {
+    double val = 0.0;
+    bounded_strtod(num_start, curr, val);
+    out = (float)val;
+  }
+  return curr;
+}
+
+/** \brief Most decimals format_fixed writes (more are clamped) */
+const unsigned max_fixed_decimals = 9;
+
+/**
+ * \brief Write val w/ a fixed number of decimals into out (needs 64 bytes) w/o
+ * allocating or touching the locale. Output is identical to printf("%.*f")
+ * (and so std::to_string at 6 decimals): val * 10^decimals is exact in double
+ * precision for decimals <= 9 so it rounds half-to-even the same way.
+ * Decimals are clamped to max_fixed_decimals so any float fits in 64 bytes.
+ * Returns number of chars written
+ */
+inline unsigned format_fixed(const float val, unsigned decimals, char* out) {
+  static const unsigned long long pow10[] = {
+      1ull,      10ull,      100ull,      1000ull,      10000ull,
+      100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull};
+  const double v = val;
+  if (decimals > max_fixed_decimals) decimals = max_fixed_decimals;
+  if (!(std::fabs(v) < 1e9)) {
+    // out of fast range (or inf/nan), at most 39 integer digits
+    const int len = snprintf(out, 64, "%.*f", (int)decimals, v);
+    return len < 64 ? (unsigned)len : 63;
+  }
+
+  const unsigned long long scaled =
+      (unsigned long long)std::nearbyint(std::fabs(v) * pow10[decimals]);
+  unsigned long long int_part = scaled / pow10[decimals];
+  unsigned long long frac_part = scaled % pow10[decimals];
+
+  char* curr = out;
+  if (std::signbit(v)) *curr++ = '-';
+
+  // integer digits (reversed into scratch)
+  char digits[24];
+  unsigned num_digits = 0;
+  do {
+    digits[num_digits++] = (char)('0' + int_part % 10);
+    int_part /= 10;
+  } while (int_part);
+  while (num_digits) *curr++ = digits[--num_digits];
+
+  if (decimals > 0) {
+    *curr++ = '.';
+    for (unsigned i = decimals; i > 0; i--) {
+      curr[i - 1] = (char)('0' + frac_part % 10);
+      frac_part /= 10;
+    }
+    curr += decimals;
+  }
+  return (unsigned)(curr - out);
+}
+
+/** \brief Returns true if view contains in_str */
+inline bool contains(const cview view, const char* in_str) {
+  const size_t in_len = strlen(in_str);
+  if (in_len == 0) return true;
+  if (in_len > view.len) return false;
 
-  while (nxt && iter < output.size()) {
-    output[iter].set(nxt);
-    iter += 1;
-    nxt = strtok(nullptr, delim);
+  const char* start = view.ptr;
+  const char* const last = view.end() - in_len;
+  while (start <= last) {
+    start = (const char*)memchr(start, *in_str, last - start + 1);
+    if (!start) return false;
+    if (memcmp(start, in_str, in_len) == 0) return true;
+    start++;
   }
-  return output;
+  return false;
 }
 }
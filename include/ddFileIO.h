@@ -1,29 +1,61 @@
 #pragma once
 
 #include "Container.h"
+#include "StringLib.h"
+#include <cstdio>
 #include <experimental/filesystem>
 #include <fstream>
 #include <string>
 #include <vector>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // !WIN32
+
 namespace dd_fs = std::experimental::filesystem;
 typedef std::experimental::filesystem::directory_iterator dd_fs_dir;
 
-enum ddIOflag { READ = 0x1, WRITE = 0x2, APPEND = 0x4, DIRECTORY = 0x8 };
+enum ddIOflag {
+  READ = 0x1,
+  WRITE = 0x2,
+  APPEND = 0x4,
+  DIRECTORY = 0x8,
+  READ_MAP = 0x10
+};
 
 template<unsigned T = 1024>
 class ddFileIO {
 public:
+  ddFileIO()
+      : map_data(nullptr),
+        map_size(0),
+        map_reserved(0),
+        map_pos(0),
+        map_released(0) {}
+
   /** \brief Destructor cleans up */
   ~ddFileIO() {
     if (file_handle.is_open()) file_handle.close();
+    unmap();
+  }
+
+  /** \brief Closes opened file (if any) */
+  void close() {
+    if (file_handle.is_open()) file_handle.close();
+    unmap();
   }
 
   /** \brief Opens a file or directory w/ flags */
   bool open(const char *fileName, const ddIOflag flags) {
     std::ios_base::openmode ios_flag = std::ios::in;
 
-    if ((unsigned)(flags & ddIOflag::READ)) {
+    if ((unsigned)(flags & ddIOflag::READ_MAP)) {
+      // map entire file into memory & hand out views into it
+      return map(fileName);
+    } else if ((unsigned)(flags & ddIOflag::READ)) {
       // open simple file to read from
       ios_flag = std::ios::in;
     } else if ((unsigned)(flags & ddIOflag::WRITE)) {
@@ -46,8 +78,68 @@ public:
     return file_handle.good();
   }
 
+  /**
+   * \brief Return view of next line in a READ_MAP file (no copy). Returns an
+   * invalid view at the end of the file or on an empty line (same as
+   * readNextLine)
+   */
+  cview readNextView() {
+    if (map_pos >= map_size) return cview();
+
+    const char *start = map_data + map_pos;
+    const char *nl = (const char *)memchr(start, '\n', map_size - map_pos);
+    const size_t len = nl ? (size_t)(nl - start) : map_size - map_pos;
+    map_pos += len + 1;
+    if (map_pos - map_released >= release_window) release(start);
+
+    if (len == 0) return cview();
+    return cview(start, len);
+  }
+
+  /** \brief Return view of the whole READ_MAP file */
+  inline cview mappedView() const { return cview(map_data, map_size); }
+
+  /**
+   * \brief Return view of the next chunk of whole lines of a READ_MAP file
+   * (at least chunk_bytes unless it's the end of the file, ending right after
+   * a '\n') so chunks can be parsed independently & stitched in order.
+   * Returns an invalid view at the end of the file. Its pages stay resident
+   * until retireChunk
+   */
+  cview readNextChunk(const size_t chunk_bytes) {
+    if (map_pos >= map_size) return cview();
+
+    const char *start = map_data + map_pos;
+    const char *end = map_data + map_size;
+    const size_t left = map_size - map_pos;
+    const char *split = chunk_bytes > 0 && chunk_bytes < left
+                            ? start + chunk_bytes - 1
+                            : end;
+    if (split < end) {
+      const char *nl = (const char *)memchr(split, '\n', end - split);
+      split = nl ? nl + 1 : end;
+    }
+    map_pos = split - map_data;
+    return cview(start, split - start);
+  }
+
+  /**
+   * \brief Drop pages of a READ_MAP file up to the end of chunk once it & every
+   * chunk before it are done (may run on another thread than readNextChunk)
+   */
+  inline void retireChunk(const cview chunk) { release(chunk.end()); }
+
   /** \brief Return last string read in */
   const char *readNextLine() {
+    if (map_data) {
+      // copy mapped line into buffer for null-terminated callers
+      const cview view = readNextView();
+      if (!view.isValid()) return nullptr;
+      const size_t len = view.len < T ? view.len : T - 1;
+      memcpy(line, view.ptr, len);
+      line[len] = '\0';
+      return line;
+    }
     if (!file_handle.eof()) {
       file_handle.getline(line, T);
       if (*line) return line;
@@ -69,27 +161,215 @@ private:
   char line[T];
   std::fstream file_handle;
   dd_array<std::string> dir_files;
+  const char *map_data;
+  size_t map_size, map_reserved, map_pos, map_released;
+  // consumed pages of a mapped file are dropped every release_window bytes
+  static const size_t release_window = 16 * 1024 * 1024;
+#ifdef WIN32
+  std::vector<char> map_buffer;
+#endif  // WIN32
+
+  /**
+   * \brief Maps file read-only w/ sequential access hints. Mapped data is
+   * always followed by a '\0' so strtod-style parsers stop at the end
+   */
+  bool map(const char *fileName) {
+    unmap();
+#ifdef WIN32
+    std::ifstream in_file(fileName, std::ios::in | std::ios::binary);
+    if (!in_file.good()) return false;
+    map_buffer.assign(std::istreambuf_iterator<char>(in_file),
+                      std::istreambuf_iterator<char>());
+    map_size = map_buffer.size();
+    map_buffer.push_back('\0');
+    map_data = map_buffer.data();
+    return true;
+#else
+    const int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat f_stat;
+    if (fstat(fd, &f_stat) != 0) {
+      ::close(fd);
+      return false;
+    }
+    map_size = (size_t)f_stat.st_size;
+
+    // reserve zeroed pages 1 byte past the file, then map the file on top
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    map_reserved = ((map_size + 1 + page - 1) / page) * page;
+    void *reserved = mmap(nullptr, map_reserved, PROT_READ,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+      ::close(fd);
+      map_size = map_reserved = 0;
+      return false;
+    }
+    if (map_size > 0) {
+      void *mapped = mmap(reserved, map_size, PROT_READ,
+                          MAP_PRIVATE | MAP_FIXED, fd, 0);
+      if (mapped == MAP_FAILED) {
+        munmap(reserved, map_reserved);
+        ::close(fd);
+        map_size = map_reserved = 0;
+        return false;
+      }
+      madvise(mapped, map_size, MADV_SEQUENTIAL);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    map_data = (const char *)reserved;
+    return true;
+#endif  // WIN32
+  }
+
+  /**
+   * \brief Drop resident pages before up_to so streaming a large file runs at
+   * constant RSS. Pages are re-read from the file if touched again
+   */
+  void release(const char *up_to) {
+#ifndef WIN32
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t end = ((size_t)(up_to - map_data) / page) * page;
+    if (end > map_released) {
+      madvise((void *)(map_data + map_released), end - map_released,
+              MADV_DONTNEED);
+      map_released = end;
+    }
+#else
+    POW2_UNUSED(up_to);
+#endif  // !WIN32
+  }
+
+  /** \brief Releases mapped file (if any) */
+  void unmap() {
+#ifdef WIN32
+    map_buffer.clear();
+#else
+    if (map_data) munmap((void *)map_data, map_reserved);
+#endif  // WIN32
+    map_data = nullptr;
+    map_size = map_reserved = map_pos = map_released = 0;
+  }
 
   dd_array<std::string> parse_directory2(dd_fs_dir &dir_handle) {
     dd_array<std::string> files;
-    std::vector<std::string> vec_files;
-    // count the number of files
-    unsigned num_files = 0;
     for (auto &p : dd_fs::directory_iterator(dir_handle)) {
-      vec_files.push_back(p.path().string());
-      num_files++;
+      files.push_back(p.path().string());
     }
+    // need to sort since directory is not sorted on all filesystems
+    std::sort(files.begin(), files.end());
 
-    files.resize(num_files);
-    // need to sort vector since directory is not sorted on all filesystems
-    std::sort(vec_files.begin(), vec_files.end());
+    return files;
+  }
+};
+
+/**
+ * \brief Buffered file writer. Output is formatted straight into a reusable
+ * buffer (no per-field allocation) & the file only sees large writes
+ */
+class ddFileWriter {
+public:
+  ddFileWriter(const size_t buffer_size = 1 << 20)
+      : file_handle(nullptr),
+        used(0),
+        in_memory(false),
+        buffer(buffer_size) {}
+
+  /** \brief Destructor flushes & closes */
+  ~ddFileWriter() { close(); }
+
+  /** \brief Opens a file to write (WRITE truncates, APPEND adds to end) */
+  bool open(const char *fileName, const ddIOflag flags) {
+    close();
+    const char *mode = ((unsigned)(flags & ddIOflag::APPEND)) ? "ab" : "wb";
+    file_handle = std::fopen(fileName, mode);
+    if (file_handle) setvbuf(file_handle, nullptr, _IONBF, 0);
+    return file_handle != nullptr;
+  }
 
-    unsigned file_idx = 0;
-    for (auto &p : vec_files) {
-      files[file_idx] = p;
-      file_idx++;
+  /**
+   * \brief Keep output in memory (buffer grows instead of flushing) so it can
+   * be formatted on one thread & written to a file later w/ view()
+   */
+  void openMemory() {
+    close();
+    in_memory = true;
+  }
+
+  /** \brief Flush & close file (if any) */
+  void close() {
+    if (file_handle) {
+      flush();
+      std::fclose(file_handle);
+      file_handle = nullptr;
     }
+    in_memory = false;
+    used = 0;
+  }
 
-    return files;
+  /** \brief Write buffered output to file (no-op in memory) */
+  void flush() {
+    if (in_memory) return;
+    if (file_handle && used > 0) {
+      std::fwrite(buffer.data(), 1, used, file_handle);
+    }
+    used = 0;
+  }
+
+  /** \brief Append len chars of str */
+  void write(const char *str, const size_t len) {
+    if (len == 0) return;  // empty views may have a null ptr
+    if (used + len > buffer.size() && in_memory) {
+      grow(len);
+    } else if (used + len > buffer.size()) {
+      flush();
+      if (len > buffer.size()) {
+        if (file_handle) std::fwrite(str, 1, len, file_handle);
+        return;
+      }
+    }
+    memcpy(buffer.data() + used, str, len);
+    used += len;
+  }
+
+  /** \brief Append a view */
+  inline void write(const cview str) { write(str.ptr, str.len); }
+
+  /** \brief Append a null-terminated string */
+  inline void write(const char *str) { write(str, strlen(str)); }
+
+  /** \brief Append a single character */
+  inline void put(const char c) {
+    if (used == buffer.size()) in_memory ? grow(1) : flush();
+    buffer[used++] = c;
+  }
+
+  /** \brief Append float w/ a fixed number of decimals (6 matches %f, max 9) */
+  inline void writeFloat(const float val, const unsigned decimals = 6) {
+    if (used + 64 > buffer.size()) in_memory ? grow(64) : flush();
+    used += StrSpace::format_fixed(val, decimals, buffer.data() + used);
   }
-};
\ No newline at end of file
+
+  inline bool isOpen() const { return file_handle != nullptr; }
+
+  /** \brief Output buffered so far (all output of a memory writer) */
+  inline cview view() const { return cview(buffer.data(), used); }
+
+private:
+  std::FILE *file_handle;
+  size_t used;
+  bool in_memory;
+  std::vector<char> buffer;
+
+  /** \brief Double memory buffer until len more chars fit */
+  void grow(const size_t len) {
+    size_t size = buffer.size() > 0 ? buffer.size() : 64;
+    while (used + len > size) size *= 2;
+    buffer.resize(size);
+  }
+
+  // non-copyable
+  ddFileWriter(const ddFileWriter &);
+  ddFileWriter &operator=(const ddFileWriter &);
+};
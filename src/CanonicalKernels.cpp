@@ -0,0 +1,142 @@
+#include "CanonicalKernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DD_X86_KERNELS
+#include <immintrin.h>
+#endif  // x86 w/ gcc or clang
+
+namespace {
+
+enum KernelISA { SCALAR, SSE2, AVX2 };
+
+/** \brief Pick the widest instruction set the running CPU supports */
+KernelISA detect_isa() {
+#ifdef DD_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return KernelISA::AVX2;
+  if (__builtin_cpu_supports("sse2")) return KernelISA::SSE2;
+#endif  // DD_X86_KERNELS
+  return KernelISA::SCALAR;
+}
+
+const KernelISA s_isa = detect_isa();
+
+void session_scalar(const Affine2D *xforms, const FrameStore &in,
+                    FrameStore &out, const size_t first,
+                    const size_t last) {
+  const unsigned n = in.numLandmarks();
+  for (size_t f = first; f < last; f++) {
+    apply_affine(xforms[f], in.xs(f), in.ys(f), n, out.xs(f), out.ys(f));
+  }
+}
+
+#ifdef DD_X86_KERNELS
+// Same operation order as apply_affine (no fma) so results are identical
+
+__attribute__((target("sse2"))) void session_sse2(const Affine2D *xforms,
+                                                  const FrameStore &in,
+                                                  FrameStore &out,
+                                                  const size_t first,
+                                                  const size_t last) {
+  const unsigned n = in.numLandmarks();
+  const unsigned n4 = n & ~3u;
+  for (size_t f = first; f < last; f++) {
+    const Affine2D &xf = xforms[f];
+    const float *x = in.xs(f), *y = in.ys(f);
+    float *o_x = out.xs(f), *o_y = out.ys(f);
+
+    const __m128 m00 = _mm_set1_ps(xf.m00), m01 = _mm_set1_ps(xf.m01);
+    const __m128 m10 = _mm_set1_ps(xf.m10), m11 = _mm_set1_ps(xf.m11);
+    const __m128 px = _mm_set1_ps(xf.px), py = _mm_set1_ps(xf.py);
+    const __m128 tx = _mm_set1_ps(xf.tx), ty = _mm_set1_ps(xf.ty);
+    for (unsigned i = 0; i < n4; i += 4) {
+      const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), px);
+      const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), py);
+      _mm_storeu_ps(o_x + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, dx),
+                                                   _mm_mul_ps(m01, dy)),
+                                        tx));
+      _mm_storeu_ps(o_y + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, dx),
+                                                   _mm_mul_ps(m11, dy)),
+                                        ty));
+    }
+    apply_affine(xf, x + n4, y + n4, n - n4, o_x + n4, o_y + n4);
+  }
+}
+
+__attribute__((target("avx2"))) void session_avx2(const Affine2D *xforms,
+                                                  const FrameStore &in,
+                                                  FrameStore &out,
+                                                  const size_t first,
+                                                  const size_t last) {
+  const unsigned n = in.numLandmarks();
+  const unsigned n8 = n & ~7u;
+  const unsigned tail = n - n8;
+
+  // lanes [0, tail) active for the last partial vector of each frame
+  alignas(32) int mask_bits[8];
+  for (unsigned i = 0; i < 8; i++) mask_bits[i] = i < tail ? -1 : 0;
+  const __m256i mask = _mm256_load_si256((const __m256i *)mask_bits);
+
+  for (size_t f = first; f < last; f++) {
+    const Affine2D &xf = xforms[f];
+    const float *x = in.xs(f), *y = in.ys(f);
+    float *o_x = out.xs(f), *o_y = out.ys(f);
+
+    const __m256 m00 = _mm256_set1_ps(xf.m00), m01 = _mm256_set1_ps(xf.m01);
+    const __m256 m10 = _mm256_set1_ps(xf.m10), m11 = _mm256_set1_ps(xf.m11);
+    const __m256 px = _mm256_set1_ps(xf.px), py = _mm256_set1_ps(xf.py);
+    const __m256 tx = _mm256_set1_ps(xf.tx), ty = _mm256_set1_ps(xf.ty);
+    for (unsigned i = 0; i < n; i += 8) {
+      const bool full = i < n8;
+      const __m256 vx =
+          full ? _mm256_loadu_ps(x + i) : _mm256_maskload_ps(x + i, mask);
+      const __m256 vy =
+          full ? _mm256_loadu_ps(y + i) : _mm256_maskload_ps(y + i, mask);
+      const __m256 dx = _mm256_sub_ps(vx, px);
+      const __m256 dy = _mm256_sub_ps(vy, py);
+      const __m256 rx = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(m00, dx), _mm256_mul_ps(m01, dy)), tx);
+      const __m256 ry = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(m10, dx), _mm256_mul_ps(m11, dy)), ty);
+      if (full) {
+        _mm256_storeu_ps(o_x + i, rx);
+        _mm256_storeu_ps(o_y + i, ry);
+      } else {
+        _mm256_maskstore_ps(o_x + i, mask, rx);
+        _mm256_maskstore_ps(o_y + i, mask, ry);
+      }
+    }
+  }
+}
+#endif  // DD_X86_KERNELS
+
+}  // namespace
+
+void apply_session_affine(const Affine2D *xforms, const FrameStore &in,
+                          FrameStore &out, const size_t first,
+                          const size_t last) {
+  POW2_VERIFY_MSG(out.numFrames() == in.numFrames() &&
+                      out.numLandmarks() == in.numLandmarks() &&
+                      last <= in.numFrames(),
+                  "Session output size mismatch", 0);
+#ifdef DD_X86_KERNELS
+  if (s_isa == KernelISA::AVX2) {
+    return session_avx2(xforms, in, out, first, last);
+  }
+  if (s_isa == KernelISA::SSE2) {
+    return session_sse2(xforms, in, out, first, last);
+  }
+#endif  // DD_X86_KERNELS
+  session_scalar(xforms, in, out, first, last);
+}
+
+const char *session_kernel_isa() {
+  switch (s_isa) {
+    case KernelISA::AVX2:
+      return "avx2";
+    case KernelISA::SSE2:
+      return "sse2";
+    default:
+      return "scalar";
+  }
+}
@@ -1,8 +1,28 @@
 #include "CanonicalParse.h"
-#include <map>
+#include <algorithm>
+#include "BoundedQueue.h"
+#include "CanonicalKernels.h"
+#include "FeatureSpec.h"
 #include "StringLib.h"
 #include "ddFileIO.h"
 
+/**
+ * \brief Compile the feature spec of args (-fs file or -mf mouth spec) into
+ * features. Returns false if the spec file fails to load
+ */
+bool compile_features(const Args &args, FeatureProgram &features,
+                      bool &use_features) {
+  use_features = false;
+  if (args.feature_spec != "") {
+    use_features = features.load(args.feature_spec.c_str());
+    return use_features;
+  } else if (args.mouth_features) {
+    const char *spec = mouth_feature_spec();
+    use_features = features.compile(cview(spec, strlen(spec)), "mouth");
+  }
+  return true;
+}
+
 void create_canonical_verts(Args args) {
   // check if necessary info is present
 
@@ -14,235 +34,781 @@ void create_canonical_verts(Args args) {
     return;
   }
 
+  // compile feature spec once for every session (-mf uses the mouth spec)
+  FeatureProgram features;
+  bool use_features = false;
+  if (!compile_features(args, features, use_features)) return;
+
   export_canonical(args.canon_in.c_str(), args.canon_gt.c_str(), glm::vec2(),
-                   1.f);
+                   1.f, args.canon_decimals,
+                   use_features ? &features : nullptr, job_threads(args.jobs),
+                   args.pipeline);
 }
 
-/** \brief Export data into calibrated space */
-void export_canonical_data(SmileData &s_data, const char *dir, const char *gdir,
-                           const unsigned d_idx, std::string &f_id,
-                           const glm::vec2 canonical_iris_pos,
-                           const float canonical_iris_dist, const bool append) {
-  // create new file
-  f_id = f_id.substr(0, 7);
-  std::string out_f_name, out_fg_name;
-  out_f_name = dir + std::string("/") + f_id + "_canon.csv";
-  out_fg_name = gdir + std::string("/") + f_id + "_canon.csv";
+bool CanonWriter::open(const std::string &in_name,
+                       const std::string &gt_name) {
+  const bool i_opened = i_out.open(in_name.c_str(), ddIOflag::WRITE);
+  return g_out.open(gt_name.c_str(), ddIOflag::WRITE) && i_opened;
+}
 
-  // get translation offset
-  cbuff<64> map_idx = "Lateral canthus (R) x";
-  const unsigned pf_r_l = s_data.gt_keys[map_idx] / 2;
-  map_idx = "Lateral canthus (L) x";
-  const unsigned pf_l_l = s_data.gt_keys[map_idx] / 2;
-  
-  glm::vec2 delta_pos = glm::vec2(-s_data.ground_data[d_idx][pf_r_l]);
+void CanonWriter::openMemory() {
+  i_out.openMemory();
+  g_out.openMemory();
+  f_out.openMemory();
+}
+
+void CanonWriter::append(const CanonWriter &rows) {
+  i_out.write(rows.i_out.view());
+  g_out.write(rows.g_out.view());
+  if (f_out.isOpen()) f_out.write(rows.f_out.view());
+}
 
-  // apply delta translation to all points
-  dd_array<glm::vec2> input_n(s_data.input_data[d_idx].size());
-  dd_array<glm::vec2> ground_n(s_data.ground_data[d_idx].size());
+void CanonWriter::close() {
+  i_out.close();
+  g_out.close();
+  f_out.close();
+}
 
-  DD_FOREACH(glm::vec2, vec, s_data.input_data[d_idx]) {  // input
-    input_n[vec.i] = *vec.ptr + delta_pos;
+void CanonWriter::writeRow(ddFileWriter &out, const float *time,
+                           const float *x, const float *y, const unsigned n) {
+  if (time) {
+    out.writeFloat(*time, decimals);
+    if (n > 0) out.put(' ');
   }
-  DD_FOREACH(glm::vec2, vec, s_data.ground_data[d_idx]) {  // ground truth
-    ground_n[vec.i] = *vec.ptr + delta_pos;
+  for (unsigned i = 0; i < n; i++) {
+    if (i > 0) out.put(' ');
+    out.writeFloat(x[i], decimals);
+    out.put(' ');
+    out.writeFloat(y[i], decimals);
   }
+  out.put('\n');
+}
 
-  // get rotation offset b/t lateral & medial iris
-  const float rot_offset = atan2(ground_n[pf_l_l].y, ground_n[pf_l_l].x);
-  glm::mat2 r_mat;
-  r_mat[0][0] = glm::cos(-rot_offset);
-  r_mat[0][1] = glm::sin(-rot_offset);
-  r_mat[1][0] = -glm::sin(-rot_offset);
-  r_mat[1][1] = glm::cos(-rot_offset);
+Affine2D canonical_affine(const glm::vec2 canthus_r, const glm::vec2 canthus_l,
+                          const glm::vec2 iris_pos, const float iris_dist) {
+  // rotation offset b/t lateral canthi (w/ right canthus at the origin)
+  const glm::vec2 delta = canthus_l - canthus_r;
+  const float rot_offset = atan2(delta.y, delta.x);
+  const float cos_r = glm::cos(-rot_offset);
+  const float sin_r = glm::sin(-rot_offset);
+
+  // scale so that canthus distance is set to a canonical distance
+  const float scale_factor = iris_dist / glm::length(delta);
+
+  // M = S * R about the right canthus, then move to iris_pos
+  Affine2D xf;
+  xf.m00 = scale_factor * cos_r;
+  xf.m01 = -scale_factor * sin_r;
+  xf.m10 = scale_factor * sin_r;
+  xf.m11 = scale_factor * cos_r;
+  xf.px = canthus_r.x;
+  xf.py = canthus_r.y;
+  xf.tx = iris_pos.x;
+  xf.ty = iris_pos.y;
+  return xf;
+}
 
-  // apply negative rotation to all points (at the current pos)
-  DD_FOREACH(glm::vec2, vec, input_n) {  // input
-    input_n[vec.i] = r_mat * (*vec.ptr);
-  }
-  DD_FOREACH(glm::vec2, vec, ground_n) {  // ground
-    ground_n[vec.i] = r_mat * (*vec.ptr);
+void apply_affine(const Affine2D &xf, const float *x, const float *y,
+                  const unsigned n, float *out_x, float *out_y) {
+  for (unsigned i = 0; i < n; i++) {
+    const float dx = x[i] - xf.px, dy = y[i] - xf.py;
+    out_x[i] = xf.m00 * dx + xf.m01 * dy + xf.tx;
+    out_y[i] = xf.m10 * dx + xf.m11 * dy + xf.ty;
   }
+}
+
+namespace {
+
+// frames per task when a session is split across threads
+const size_t canon_chunk_frames = 256;
+
+/** \brief State of a file pair while its frame ranges are exported */
+struct CanonSession {
+  std::string in_file, gt_file;
+  std::string i_name, g_name, f_name;  // output files
+  SmileData data;
+  size_t frames = 0;
+  dd_array<Affine2D> xforms;
+  FrameStore input, ground;  // canonical copies of the session
+  std::vector<LandmarkRef> bound;
+  bool use_features = false;
+  std::vector<std::unique_ptr<CanonWriter>> chunks;  // rows of each range
+  std::atomic<unsigned> chunks_left;
+  JobLog log;
+  unsigned parse_threads = 1;  // threads to parse each file w/
+  const ProjectionPlan *plan = nullptr;  // fused: projection of the raw file
+  WriterSet projected;  // fused: formatted query sets (if kept)
+};
+
+}  // namespace
+
+/** \brief Load a file pair. Returns false if the input file has no frames */
+bool load_canonical_data(CanonSession &session) {
+  SmileData &s_data = session.data;
+  extract_vector2(session.in_file.c_str(), VecType::INPUT, s_data,
+                  &session.log, session.parse_threads);
+  extract_vector2(session.gt_file.c_str(), VecType::OUTPUT, s_data,
+                  &session.log, session.parse_threads);
+  return s_data.input_data.numFrames() > 0;
+}
 
-  // scale points so that iris distance is set to a canonical distance
-  const float dist = glm::distance(ground_n[pf_r_l], ground_n[pf_l_l]);
-  const float scale_factor = canonical_iris_dist / dist;
-  glm::mat2 s_mat;
-  s_mat[0][0] = s_mat[1][1] = scale_factor;
-  s_mat[0][1] = s_mat[1][0] = 0.f;
+/**
+ * \brief Compute each frame's transform of a loaded file pair into
+ * session.frames. Returns false (0 frames) if the ground truth has no lateral
+ * canthus columns to calibrate w/, so the session is skipped
+ */
+bool prepare_canonical_data(CanonSession &session,
+                            const glm::vec2 canonical_iris_pos,
+                            const float canonical_iris_dist,
+                            const FeatureProgram *features) {
+  SmileData &s_data = session.data;
+  session.frames = 0;
 
-  DD_FOREACH(glm::vec2, vec, input_n) {  // input
-    input_n[vec.i] = s_mat * (*vec.ptr);
+  // get translation offset
+  const Landmark canthi[2] = {LATERAL_CANTHUS_R, LATERAL_CANTHUS_L};
+  for (const Landmark lm : canthi) {
+    if (!s_data.gt_index.has(lm)) {
+      session.log.post("    Skipping: missing column %s x\n",
+                       landmark_names[lm]);
+      return false;
+    }
   }
-  DD_FOREACH(glm::vec2, vec, ground_n) {  // ground
-    ground_n[vec.i] = s_mat * (*vec.ptr);
+  const unsigned pf_r_l = s_data.gt_index[LATERAL_CANTHUS_R];
+  const unsigned pf_l_l = s_data.gt_index[LATERAL_CANTHUS_L];
+
+  const FrameStore &in_store = s_data.input_data;
+  const FrameStore &gt_store = s_data.ground_data;
+  session.frames = std::min(in_store.numFrames(), gt_store.numFrames());
+
+  // per-frame transforms (canthi are columns of the header, so in bounds)
+  session.xforms.resize(session.frames, dd_no_init);
+  for (size_t j = 0; j < session.frames; j++) {
+    session.xforms[j] =
+        canonical_affine(gt_store.get(j, pf_r_l), gt_store.get(j, pf_l_l),
+                         canonical_iris_pos, canonical_iris_dist);
   }
+  session.input.resize(in_store.numLandmarks(), in_store.numFrames());
+  session.ground.resize(gt_store.numLandmarks(), gt_store.numFrames());
 
-  // apply translation to all points to move iris to canonical position
-  DD_FOREACH(glm::vec2, vec, input_n) {
-    *vec.ptr += canonical_iris_pos;
+  session.use_features = features && features->link(s_data.i_index,
+                                                     s_data.gt_index,
+                                                     session.bound);
+  return true;
+}
+
+/**
+ * \brief Transform frames [first, last) of a session into calibrated space.
+ * The range's transforms are applied to all landmarks of all its frames in
+ * one batch
+ */
+void transform_canonical_data(CanonSession &session, const size_t first,
+                              const size_t last) {
+  apply_session_affine(session.xforms.data(), session.data.input_data,
+                       session.input, first, last);
+  apply_session_affine(session.xforms.data(), session.data.ground_data,
+                       session.ground, first, last);
+}
+
+/** \brief Write transformed frames [first, last) (appends rows to writer) */
+void write_canonical_data(CanonSession &session, CanonWriter &writer,
+                          const size_t first, const size_t last,
+                          const FeatureProgram *features) {
+  const FrameStore &in_store = session.data.input_data;
+  const FrameStore &gt_store = session.data.ground_data;
+
+  // write out input and ground rows (time stamp first if exists). Range is
+  // checked once, rows are read w/o per-element checks
+  const unsigned in_n = in_store.numLandmarks();
+  const unsigned gt_n = gt_store.numLandmarks();
+  POW2_VERIFY_MSG(last <= session.input.numFrames() &&
+                      last <= session.ground.numFrames(),
+                  "Frame range out of bounds", 0);
+  POW2_VERIFY_MSG(in_store.time.size() == 0 || last <= in_store.time.size(),
+                  "Missing input time stamps", 0);
+  POW2_VERIFY_MSG(gt_store.time.size() == 0 || last <= gt_store.time.size(),
+                  "Missing ground truth time stamps", 0);
+  for (size_t j = first; j < last; j++) {
+    writer.writeRow(writer.i_out,
+                    in_store.time.size() > 0 ? &in_store.time[j] : nullptr,
+                    session.input.xs(j), session.input.ys(j), in_n);
+    writer.writeRow(writer.g_out,
+                    gt_store.time.size() > 0 ? &gt_store.time[j] : nullptr,
+                    session.ground.xs(j), session.ground.ys(j), gt_n);
   }
-  DD_FOREACH(glm::vec2, vec, ground_n) {
-    *vec.ptr += canonical_iris_pos;
+
+  // optional feature stage straight from the canonical data (columns are
+  // scratch of this range, from the thread's arena)
+  if (session.use_features) {
+    static thread_local dd_arena scratch(1 << 18);
+    scratch.reset();
+    dd_array<float> columns(0, &scratch);
+    features->evaluate(session.bound, session.input, session.ground, first,
+                       last - first, columns);
+    features->write(columns, last - first, writer.f_out, writer.decimals);
   }
+}
 
-  // write out input and ground file
-  ddFileIO<> i_out, g_out;
-  if (append) {
-    i_out.open(out_f_name.c_str(), ddIOflag::APPEND);
-  } else {
-    i_out.open(out_f_name.c_str(), ddIOflag::WRITE);
+void export_canonical(const char *input_dir, const char *ground_dir,
+                      const glm::vec2 canonical_iris_pos,
+                      const float canonical_iris_dist,
+                      const unsigned decimals, const FeatureProgram *features,
+                      const unsigned threads, const bool pipeline) {
+  // export input files
+  ddFileIO<> io_input, io_ground;
+  bool success = io_input.open(input_dir, ddIOflag::DIRECTORY);
+  success |= io_ground.open(ground_dir, ddIOflag::DIRECTORY);
+  if (!success) return;
+
+  // for each file:
+  dd_array<std::string> i_files = io_input.get_directory_files();
+  printf("Opening in dir: %s..\n", input_dir);
+  printf("Opening ground dir: %s..\n", ground_dir);
+  printf("Canonical kernel: %s\n", session_kernel_isa());
+  if (threads > 1) printf("Canonical jobs: %u threads\n", threads);
+  if (pipeline) printf("Canonical pipeline\n");
+
+  std::vector<std::unique_ptr<CanonSession>> sessions;
+  for (auto &file : i_files) {
+    if (file.find("_s_out.csv") == std::string::npos &&
+        file.find("_v_out.csv") == std::string::npos) {
+      continue;
+    }
+    // get name of file (ground truth file has the same name)
+    const std::string &f_name = file;
+    const size_t idx = f_name.find_last_of("\\/");
+    const std::string f_id = f_name.substr(idx + 1).substr(0, 7);
+
+    sessions.push_back(std::unique_ptr<CanonSession>(new CanonSession()));
+    CanonSession &session = *sessions.back();
+    session.in_file = f_name;
+    session.gt_file = ground_dir + std::string("/") + f_name.substr(idx + 1);
+    session.i_name = input_dir + std::string("/") + f_id + "_canon.csv";
+    session.g_name = ground_dir + std::string("/") + f_id + "_canon.csv";
+    if (features) {
+      session.f_name = input_dir + std::string("/") + f_id + "_feat.csv";
+    }
   }
 
-  std::string out_str;
-  std::string _sp(" ");
+  // sessions print in file order once written
+  const unsigned num_sessions = (unsigned)sessions.size();
+  JobRetirer retirer(num_sessions, [&](const unsigned i) {
+    sessions[i]->log.flush();
+    sessions[i].reset();
+  });
+
+  if (pipeline) {
+    // load (1 thread) -> transform (threads) -> format & write (threads)
+    BoundedQueue<unsigned> load_q("load -> transform", threads * 2);
+    BoundedQueue<unsigned> write_q("transform -> write", threads * 2, threads);
+    StageClock load_clock("load", 1), xform_clock("transform", threads),
+        write_clock("write", threads);
+
+    std::thread loader([&]() {
+      for (unsigned i = 0; i < num_sessions; i++) {
+        {
+          StageTimer timer(load_clock);
+          CanonSession &session = *sessions[i];
+          session.log.post("  Exporting: %s\n", session.in_file.c_str());
+          load_canonical_data(session);
+        }
+        load_q.push(i);
+      }
+      load_q.producerDone();
+    });
+
+    std::vector<std::thread> stages;
+    for (unsigned t = 0; t < threads; t++) {
+      stages.push_back(std::thread([&]() {
+        unsigned i = 0;
+        while (load_q.pop(i)) {
+          {
+            StageTimer timer(xform_clock);
+            CanonSession &session = *sessions[i];
+            if (session.data.input_data.numFrames() > 0) {
+              if (prepare_canonical_data(session, canonical_iris_pos,
+                                         canonical_iris_dist, features)) {
+                transform_canonical_data(session, 0, session.frames);
+              } else {
+                // skipped: drop the data so no files are written
+                session.data = SmileData();
+              }
+            }
+          }
+          write_q.push(i);
+        }
+        write_q.producerDone();
+      }));
+    }
+    for (unsigned t = 0; t < threads; t++) {
+      stages.push_back(std::thread([&]() {
+        unsigned i = 0;
+        while (write_q.pop(i)) {
+          {
+            StageTimer timer(write_clock);
+            CanonSession &session = *sessions[i];
+            if (session.data.input_data.numFrames() > 0) {
+              CanonWriter writer(decimals);
+              writer.open(session.i_name, session.g_name);
+              if (features) {
+                writer.f_out.open(session.f_name.c_str(), ddIOflag::WRITE);
+              }
+              write_canonical_data(session, writer, 0, session.frames,
+                                   features);
+            }
+            session.data = SmileData();
+            session.input = session.ground = FrameStore();
+          }
+          retirer.done(i);
+        }
+      }));
+    }
+    loader.join();
+    for (auto &t : stages) t.join();
+
+    printf("Canonical pipeline stages:\n");
+    load_clock.report();
+    load_q.report();
+    xform_clock.report();
+    write_q.report();
+    write_clock.report();
+    return;
+  }
 
-  // record time if if exists
-  if (s_data.time_stamps_i.size() > 0) {
-    out_str = std::to_string(s_data.time_stamps_i[d_idx]) + _sp;
+  // spare threads (more threads than files) split parsing of each file
+  for (auto &session : sessions) {
+    session->parse_threads =
+        threads > num_sessions ? threads / num_sessions : 1;
   }
 
-  DD_FOREACH(glm::vec2, vec, input_n) {
-    out_str +=
-        std::to_string(vec.ptr->x) + _sp + std::to_string(vec.ptr->y) + _sp;
+  // last range of a session to finish writes its output files
+  auto write_session = [&](const unsigned i) {
+    CanonSession &session = *sessions[i];
+    CanonWriter writer(decimals);
+    writer.open(session.i_name, session.g_name);
+    if (features) writer.f_out.open(session.f_name.c_str(), ddIOflag::WRITE);
+    for (auto &rows : session.chunks) writer.append(*rows);
+    writer.close();
+
+    // only the log is kept until earlier sessions are done
+    session.data = SmileData();
+    session.input = session.ground = FrameStore();
+    session.chunks.clear();
+    // ddTerminal::post("---> Done.");
+    retirer.done(i);
+  };
+
+  TaskPool pool(threads);
+  auto load_session = [&](const unsigned i) {
+    CanonSession &session = *sessions[i];
+    session.log.post("  Exporting: %s\n", session.in_file.c_str());
+
+    if (!load_canonical_data(session)) {
+      retirer.done(i);
+      return;
+    }
+    if (!prepare_canonical_data(session, canonical_iris_pos,
+                                canonical_iris_dist, features)) {
+      retirer.done(i);
+      return;
+    }
+    const size_t frames = session.frames;
+
+    // split session into frame ranges (any idle thread may steal them)
+    const unsigned num_chunks =
+        (unsigned)((frames + canon_chunk_frames - 1) / canon_chunk_frames);
+    session.chunks_left = num_chunks;
+    if (num_chunks == 0) return write_session(i);
+    for (unsigned c = 0; c < num_chunks; c++) {
+      session.chunks.push_back(
+          std::unique_ptr<CanonWriter>(new CanonWriter(decimals, 1 << 16)));
+      session.chunks.back()->openMemory();
+    }
+    for (unsigned c = num_chunks; c-- > 0;) {
+      pool.spawn([&, i, c]() {
+        CanonSession &session = *sessions[i];
+        const size_t first = c * canon_chunk_frames;
+        const size_t last =
+            std::min(first + canon_chunk_frames, session.frames);
+        transform_canonical_data(session, first, last);
+        write_canonical_data(session, *session.chunks[c], first, last,
+                             features);
+        if (--session.chunks_left == 0) write_session(i);
+      });
+    }
+  };
+
+  // seed in reverse so each worker starts w/ its earliest file
+  for (unsigned i = (unsigned)sessions.size(); i-- > 0;) {
+    pool.spawn([&, i]() { load_session(i); });
   }
-  out_str.pop_back();
-  out_str += "\n";
-  i_out.writeLine(out_str.c_str());
+  pool.run();
+}
 
-  if (append) {
-    g_out.open(out_fg_name.c_str(), ddIOflag::APPEND);
-  } else {
-    g_out.open(out_fg_name.c_str(), ddIOflag::WRITE);
+/** \brief Parse the selected columns of a plan into a new frame of store */
+void parse_projected_frame(const std::vector<cview> &vals,
+                           const ColumnPlan &plan, const bool time_flag,
+                           FrameStore &store) {
+  const size_t r_idx = store.addFrame();
+  float *row_x = store.xs(r_idx), *row_y = store.ys(r_idx);
+  float val = 0.f;
+
+  size_t i = 0;
+  if (time_flag && i < plan.slot.size()) {
+    const cview &field = vals[plan.slot[i++]];
+    StrSpace::parse_float(field.ptr, field.end(), val);
+    store.time.push_back(val);
   }
+  for (unsigned c = 0; i + 1 < plan.slot.size() && c < store.numLandmarks();
+       i += 2, c++) {
+    const cview &x = vals[plan.slot[i]], &y = vals[plan.slot[i + 1]];
+    StrSpace::parse_float(x.ptr, x.end(), row_x[c]);
+    StrSpace::parse_float(y.ptr, y.end(), row_y[c]);
+  }
+}
 
-  out_str = "";
-  // record time if if exists
-  if (s_data.time_stamps_gt.size() > 0) {
-    out_str = std::to_string(s_data.time_stamps_gt[d_idx]) + _sp;
+/**
+ * \brief Parse the projected input & ground truth columns of each raw row of a
+ * chunk (& format all query sets into text if set). Returns false if the chunk
+ * hit an empty line (end of data)
+ */
+bool parse_projected_rows(const cview chunk, const ProjectionPlan &projection,
+                          const bool in_time, const bool gt_time,
+                          FrameStore &input, FrameStore &ground,
+                          WriterSet *text) {
+  std::vector<cview> vals;
+  const char *next = chunk.ptr;
+  while (next < chunk.end()) {
+    const cview line = StrSpace::next_line(next, chunk.end());
+    if (line.len == 0) return false;
+
+    // tokenize once for both stores
+    StrSpace::select(line, ',', projection.plans[0].scan, vals);
+    parse_projected_frame(vals, projection.plans[0], in_time, input);
+    parse_projected_frame(vals, projection.plans[1], gt_time, ground);
+    if (text) write_selected(projection, vals, ' ', *text);
   }
+  return true;
+}
 
-  DD_FOREACH(glm::vec2, vec, ground_n) {
-    out_str +=
-        std::to_string(vec.ptr->x) + _sp + std::to_string(vec.ptr->y) + _sp;
+/**
+ * \brief Load a raw file of a fused session straight into its input & ground
+ * truth stores (1st & 2nd query set). Returns false if it has no frames
+ */
+bool load_fused_data(CanonSession &session, SchemaCache &schemas,
+                     const std::vector<QuerySet> &sets, const bool keep) {
+  ddFileIO<> raw;
+  if (!raw.open(session.in_file.c_str(), ddIOflag::READ_MAP)) return false;
+  const cview header = raw.readNextView();
+  if (!header.isValid()) return false;
+  session.plan = &schemas.resolve(header, sets);
+  const ProjectionPlan &projection = *session.plan;
+
+  // landmark index & stores from the projected header of each set
+  SmileData &s_data = session.data;
+  std::vector<cview> vals, fields;
+  StrSpace::select(header, ',', projection.plans[0].scan, vals);
+  bool time_flags[2] = {false, false};
+  for (unsigned k = 0; k < 2; k++) {
+    fields.clear();
+    for (auto &slot : projection.plans[k].slot) fields.push_back(vals[slot]);
+    const unsigned vec_size = vector_index(
+        fields, k == 0 ? s_data.i_index : s_data.gt_index, time_flags[k]);
+    session.log.post("    Creating new input vectors(%u)...\n", vec_size);
+    (k == 0 ? s_data.input_data : s_data.ground_data).reset(vec_size);
   }
-  out_str.pop_back();
-  out_str += "\n";
-  g_out.writeLine(out_str.c_str());
+  if (keep) {
+    session.projected = memory_writers(sets.size());
+    write_selected(projection, vals, ',', session.projected);
+  }
+
+  // populate stores chunk by chunk (w/ more than 1 thread a window of chunks
+  // is parsed in parallel & stitched in file order, else rows go straight in)
+  const unsigned threads = session.parse_threads;
+  const bool direct = threads <= 1;
+  const unsigned window = direct ? 1 : threads * 2;
+  std::vector<cview> chunks(window);
+  std::vector<SmileData> parts(window);
+  std::vector<WriterSet> text(window);
+  std::vector<char> complete(window, 0);
+  bool stopped = false;
+  run_window(threads, window,
+             [&](const unsigned c) {
+               if (stopped) return false;
+               chunks[c] = raw.readNextChunk(parse_chunk_bytes);
+               return chunks[c].isValid();
+             },
+             [&](const unsigned c) {
+               if (direct) {
+                 complete[c] = parse_projected_rows(
+                     chunks[c], projection, time_flags[0], time_flags[1],
+                     s_data.input_data, s_data.ground_data,
+                     keep ? &session.projected : nullptr);
+                 return;
+               }
+               parts[c].input_data.reset(s_data.input_data.numLandmarks());
+               parts[c].ground_data.reset(s_data.ground_data.numLandmarks());
+               if (keep) text[c] = memory_writers(sets.size());
+               complete[c] = parse_projected_rows(
+                   chunks[c], projection, time_flags[0], time_flags[1],
+                   parts[c].input_data, parts[c].ground_data,
+                   keep ? &text[c] : nullptr);
+             },
+             [&](const unsigned c) {
+               // rows after an empty line are not part of the data
+               if (!direct && !stopped) {
+                 s_data.input_data.append(parts[c].input_data);
+                 s_data.ground_data.append(parts[c].ground_data);
+                 for (size_t p = 0; p < text[c].size(); p++) {
+                   session.projected[p]->write(text[c][p]->view());
+                 }
+               }
+               stopped = stopped || !complete[c];
+               parts[c] = SmileData();
+               text[c].clear();
+               raw.retireChunk(chunks[c]);
+             });
+  return s_data.input_data.numFrames() > 0;
 }
 
-void export_canonical(const char *input_dir, const char *ground_dir,
-                      const glm::vec2 canonical_iris_pos,
-                      const float canonical_iris_dist) {
-  // export input files
-  ddFileIO<> io_input, io_ground;
-  bool success = io_input.open(input_dir, ddIOflag::DIRECTORY);
-  success |= io_ground.open(ground_dir, ddIOflag::DIRECTORY);
-  if (success) {
-    // for each file:
-    dd_array<std::string> i_files = io_input.get_directory_files();
-    dd_array<std::string> g_files = io_ground.get_directory_files();
-    printf("Opening in dir: %s..\n", input_dir);
-    printf("Opening ground dir: %s..\n", ground_dir);
-    DD_FOREACH(std::string, file, i_files) {
-      const char *g_file = g_files[file.i].c_str();
-      // get name of file
-      const std::string f_name = file.ptr->c_str();
-      const size_t idx = f_name.find_last_of("\\/");
-
-      if (file.ptr->find("_s_out.csv") != std::string::npos ||
-          file.ptr->find("_v_out.csv") != std::string::npos) {
-        printf("  Exporting: %s\n", f_name.c_str());
-
-        // TODO: Change smile data to parameter and not return
-        SmileData s_data;
-        extract_vector2(file.ptr->c_str(), VecType::INPUT, s_data);
-        extract_vector2(g_file, VecType::OUTPUT, s_data);
-
-        // loop thru lines fo each and write to output file
-        for (size_t j = 0; j < s_data.input_data.size(); j++) {
-          const bool append = (j == 0) ? false : true;
-
-          std::string file_substr = f_name.substr(idx + 1);
-
-          export_canonical_data(s_data, input_dir, ground_dir, j,
-                                file_substr, canonical_iris_pos,
-                                canonical_iris_dist, append);
+void create_fused_dataset(Args args) {
+  // check if necessary info is present
+  if (args.input_dir == "" || args.query_sets.size() < 2) {
+    printf(
+        "Error: Fused mode needs an input directory & 2 query sets (input "
+        "then ground truth)\n");
+    return;
+  }
+  FeatureProgram features;
+  bool use_features = false;
+  if (!compile_features(args, features, use_features)) return;
+
+  ddFileIO<> io_handle;
+  if (!io_handle.open(args.input_dir.c_str(), ddIOflag::DIRECTORY)) return;
+  dd_array<std::string> files = io_handle.get_directory_files();
+
+  // sessions in name order (directory files are sorted, same order as
+  // concatenating per-file outputs)
+  std::vector<std::string> raw_files;
+  for (auto &file : files) {
+    if (file.find("_s.csv") != std::string::npos ||
+        file.find("_v.csv") != std::string::npos) {
+      raw_files.push_back(file);
+    }
+  }
+
+  const std::string i_name = args.fused_dir + "/all_canonical_input.csv";
+  const std::string g_name = args.fused_dir + "/all_canonical_ground.csv";
+  ddFileWriter i_out, g_out;
+  if (!i_out.open(i_name.c_str(), ddIOflag::WRITE) ||
+      !g_out.open(g_name.c_str(), ddIOflag::WRITE)) {
+    return;
+  }
+
+  const unsigned num_sessions = (unsigned)raw_files.size();
+  const unsigned threads = job_threads(args.jobs);
+  printf("Input dir:  %s\n", args.input_dir.c_str());
+  printf("Fused input:  %s\n", i_name.c_str());
+  printf("Fused ground: %s\n", g_name.c_str());
+  printf("Canonical kernel: %s\n", session_kernel_isa());
+  if (threads > 1) printf("Canonical jobs: %u threads\n", threads);
+
+  // intermediate files go to the output dir of their query set
+  const QuerySet &in_set = args.query_sets[0], &gt_set = args.query_sets[1];
+  const std::string &in_dir =
+      in_set.output_dir != "" ? in_set.output_dir : args.output_dir;
+  const std::string &gt_dir =
+      gt_set.output_dir != "" ? gt_set.output_dir : args.output_dir;
+
+  std::vector<std::unique_ptr<CanonSession>> sessions;
+  std::vector<std::string> stripped;
+  for (auto &raw_file : raw_files) {
+    const size_t idx = raw_file.find_last_of("\\/");
+    std::string f_id = raw_file.substr(idx + 1);
+    stripped.push_back(f_id.substr(0, f_id.size() - 4));
+    f_id = f_id.substr(0, 7);
+
+    sessions.push_back(std::unique_ptr<CanonSession>(new CanonSession()));
+    CanonSession &session = *sessions.back();
+    session.in_file = raw_file;
+    session.i_name = in_dir + std::string("/") + f_id + "_canon.csv";
+    session.g_name = gt_dir + std::string("/") + f_id + "_canon.csv";
+    if (use_features) {
+      session.f_name = in_dir + std::string("/") + f_id + "_feat.csv";
+    }
+    // spare threads (more threads than files) split parsing of each file
+    session.parse_threads =
+        threads > num_sessions ? threads / num_sessions : 1;
+  }
+
+  SchemaCache schemas;
+  const FeatureProgram *program = use_features ? &features : nullptr;
+  auto job = [&](const unsigned i) {
+    CanonSession &session = *sessions[i];
+    session.log.post("  Exporting: %s\n", session.in_file.c_str());
+    const bool loaded = load_fused_data(session, schemas, args.query_sets,
+                                        args.keep_intermediate);
+    if (loaded &&
+        prepare_canonical_data(session, glm::vec2(), 1.f, program)) {
+      const size_t frames = session.frames;
+      transform_canonical_data(session, 0, frames);
+      session.chunks.push_back(std::unique_ptr<CanonWriter>(
+          new CanonWriter(args.canon_decimals, 1 << 16)));
+      session.chunks.back()->openMemory();
+      write_canonical_data(session, *session.chunks.back(), 0, frames,
+                           program);
+    }
+    session.data = SmileData();
+    session.input = session.ground = FrameStore();
+  };
+  // sessions are appended to the datasets (& logs printed) in file order
+  auto finish = [&](const unsigned i) {
+    CanonSession &session = *sessions[i];
+    if (session.plan) schemas.report(*session.plan, session.in_file.c_str());
+    for (auto &rows : session.chunks) {
+      i_out.write(program ? rows->f_out.view() : rows->i_out.view());
+      g_out.write(rows->g_out.view());
+    }
+
+    if (args.keep_intermediate) {
+      Args f_args = args;
+      f_args.stripped_filename = stripped[i];
+      for (size_t p = 0; p < session.projected.size(); p++) {
+        ddFileWriter out(1 << 16);
+        const std::string outfile = output_file(f_args, args.query_sets[p]);
+        if (out.open(outfile.c_str(), ddIOflag::WRITE)) {
+          out.write(session.projected[p]->view());
         }
-        // ddTerminal::post("---> Done.");
       }
+      if (!session.chunks.empty()) {
+        CanonWriter writer(args.canon_decimals, 1 << 16);
+        writer.open(session.i_name, session.g_name);
+        if (program) writer.f_out.open(session.f_name.c_str(), ddIOflag::WRITE);
+        writer.append(*session.chunks.back());
+      }
+    }
+    session.log.flush();
+    sessions[i].reset();
+  };
+  run_jobs(num_sessions, threads, std::vector<unsigned>(), job, finish);
+}
+
+/**
+ * \brief Parse rows of a chunk of a vector file into store (time stamps too if
+ * time_flag). Returns false if the chunk hit an empty line (end of data)
+ */
+bool parse_vector_rows(const cview chunk, const bool time_flag,
+                       FrameStore &out_vec) {
+  const unsigned vec_size = out_vec.numLandmarks();
+  const char *next = chunk.ptr;
+  while (next < chunk.end()) {
+    const cview line = StrSpace::next_line(next, chunk.end());
+    if (line.len == 0) return false;
+
+    const size_t r_idx = out_vec.addFrame();
+    float *row_x = out_vec.xs(r_idx), *row_y = out_vec.ys(r_idx);
+
+    // loop thru columns per row (line is a view into the mapped file)
+    unsigned c_idx = 0;
+    bool time_recorded = false;
+    const char *curr_row = line.ptr;
+    while (curr_row < line.end()) {
+      const char *nxt_flt = nullptr;
+      float val = 0.f;
+      if (time_flag && !time_recorded) {
+        // get time info
+        nxt_flt = StrSpace::parse_float(curr_row, line.end(), val);
+        out_vec.time.push_back(val);
+        time_recorded = true;
+      } else {
+        // get x & y axis
+        nxt_flt = StrSpace::parse_float(curr_row, line.end(), val);
+        if (nxt_flt == curr_row) break;  // trailing whitespace
+        POW2_VERIFY_MSG(c_idx < vec_size, "Too many columns: %u", c_idx);
+        row_x[c_idx] = val;
+        curr_row = nxt_flt;
+        nxt_flt = StrSpace::parse_float(curr_row, line.end(), val);
+        POW2_VERIFY_MSG(nxt_flt != curr_row, "Y axis error: column %u", c_idx);
+        row_y[c_idx] = val;
+        c_idx++;
+      }
+      if (nxt_flt == curr_row) break;
+      curr_row = nxt_flt;
     }
   }
+  return true;
+}
+
+unsigned vector_index(const std::vector<cview> &fields, LandmarkIndex &index,
+                      bool &time_flag) {
+  time_flag = false;
+  index.clear();
+  for (unsigned i = 0; i < (unsigned)fields.size(); i++) {
+    // set offset if time column is present (must be 1st column)
+    if (StrSpace::contains(fields[i], "time")) {
+      time_flag = true;
+      continue;
+    }
+    // landmark columns are keyed by their x column (x, y pairs)
+    const cview field = fields[i];
+    if (field.len < 2 || memcmp(field.end() - 2, " x", 2) != 0) continue;
+    index.add(cview(field.ptr, field.len - 2), (time_flag ? i - 1 : i) / 2);
+  }
+  return time_flag ? (fields.size() - 1) / 2 : (fields.size()) / 2;
 }
 
 void extract_vector2(const char *in_file, const VecType type,
-                     SmileData &sdata) {
+                     SmileData &sdata, JobLog *log, const unsigned threads) {
   // set up handles
-  std::vector<dd_array<glm::vec2>> &out_vec =
+  FrameStore &out_vec =
       (type == VecType::INPUT) ? sdata.input_data : sdata.ground_data;
-  std::map<cbuff<64>, unsigned> &out_keys =
-      (type == VecType::INPUT) ? sdata.i_keys : sdata.gt_keys;
-  std::vector<float> &t_stamp =
-      (type == VecType::INPUT) ? sdata.time_stamps_i : sdata.time_stamps_gt;
+  LandmarkIndex &out_index =
+      (type == VecType::INPUT) ? sdata.i_index : sdata.gt_index;
 
   // file/directory reader
   ddFileIO<> vec_io;
 
-  bool success = vec_io.open(in_file, ddIOflag::READ);
+  bool success = vec_io.open(in_file, ddIOflag::READ_MAP);
 
   if (success) {
     // get vector size
-    const char *line = vec_io.readNextLine();
-    dd_array<cbuff<64>> indices;
-    const std::string _f = in_file;
+    cview line = vec_io.readNextView();
+    std::vector<cview> indices;
     bool time_flag = false;
 
-    indices = StrSpace::tokenize1024<64>(line, ",");
-    DD_FOREACH(cbuff<64>, _key, indices) {
-      // set offset if time column is present (must be 1st column)
-      if (_key.ptr->contains("time")) {
-        time_flag = true;
-      } else {
-        out_keys[*_key.ptr] = time_flag ? _key.i - 1 : _key.i;
-      }
-    }
-    line = vec_io.readNextLine();
-
-    const unsigned vec_size =
-        time_flag ? (indices.size() - 1) / 2 : (indices.size()) / 2;
-
-    printf("    Creating new input vectors(%u)...\n", (unsigned)vec_size);
-    // populate vector
-    unsigned r_idx = 0;
-    while (line) {
-      // printf("%s\n", line);
-      out_vec.push_back(dd_array<glm::vec2>(vec_size));
-
-      // loop thru columns per row
-      unsigned c_idx = 0;
-      bool time_recorded = false;
-      const char *curr_row = line;
-      while (*curr_row) {
-        char *nxt_dbl = nullptr;
-        // printf("%s\n", curr_row);
-        if (time_flag && !time_recorded) {
-          // get time info
-          t_stamp.push_back(std::strtod(curr_row, &nxt_dbl));
-          time_recorded = true;
-        } else {
-          // get x & y axis
-          out_vec[r_idx][c_idx].x = std::strtod(curr_row, &nxt_dbl);
-          curr_row = nxt_dbl;
-          POW2_VERIFY_MSG(nxt_dbl != nullptr, "Y axis error: column %u", c_idx);
-          out_vec[r_idx][c_idx].y = std::strtod(curr_row, &nxt_dbl);
-          c_idx++;
-        }
-        curr_row = nxt_dbl;
-      }
-      // // std::cout << out_vec[idx] << "\n\n";
-
-      line = vec_io.readNextLine();
-      r_idx++;
-    }
+    StrSpace::tokenize(line, ',', indices);
+    const unsigned vec_size = vector_index(indices, out_index, time_flag);
+
+    job_post(log, "    Creating new input vectors(%u)...\n",
+             (unsigned)vec_size);
+    out_vec.reset(vec_size);
+    if (!line.isValid()) return;
+
+    // populate vector chunk by chunk (w/ more than 1 thread a window of
+    // chunks is parsed in parallel & stitched in file order, else rows go
+    // straight in)
+    const bool direct = threads <= 1;
+    const unsigned window = direct ? 1 : threads * 2;
+    std::vector<cview> chunks(window);
+    std::vector<FrameStore> parts(window);
+    std::vector<char> complete(window, 0);
+    bool stopped = false;
+    run_window(threads, window,
+               [&](const unsigned c) {
+                 if (stopped) return false;
+                 chunks[c] = vec_io.readNextChunk(parse_chunk_bytes);
+                 return chunks[c].isValid();
+               },
+               [&](const unsigned c) {
+                 if (!direct) parts[c].reset(vec_size, 0);
+                 complete[c] = parse_vector_rows(chunks[c], time_flag,
+                                                 direct ? out_vec : parts[c]);
+               },
+               [&](const unsigned c) {
+                 // rows after an empty line are not part of the data
+                 if (!direct && !stopped) out_vec.append(parts[c]);
+                 stopped = stopped || !complete[c];
+                 parts[c] = FrameStore();
+                 vec_io.retireChunk(chunks[c]);
+               });
   }
 }
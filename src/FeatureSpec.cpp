@@ -0,0 +1,303 @@
+#include "FeatureSpec.h"
+#include <cmath>
+#include <functional>
+#include "ddFileIO.h"
+
+namespace {
+
+/** \brief Spec op names, arg counts & whether args are features */
+struct OpInfo {
+  const char *name;
+  FeatureOp op;
+  unsigned num_args;
+  bool feature_args;
+};
+
+const OpInfo op_table[] = {
+    {"dx", FeatureOp::DX, 2, false},
+    {"dy", FeatureOp::DY, 2, false},
+    {"absdx", FeatureOp::ABS_DX, 2, false},
+    {"absdy", FeatureOp::ABS_DY, 2, false},
+    {"dist", FeatureOp::DIST, 2, false},
+    {"angle", FeatureOp::ANGLE, 2, false},
+    {"ratio", FeatureOp::RATIO, 2, true},
+    {"symmetry", FeatureOp::SYMMETRY, 3, false},
+};
+
+/** \brief Strip leading & trailing whitespace */
+cview trim(cview str) {
+  while (str.len > 0 && isspace((unsigned char)str.ptr[0])) {
+    str.ptr++;
+    str.len--;
+  }
+  while (str.len > 0 && isspace((unsigned char)str.ptr[str.len - 1])) {
+    str.len--;
+  }
+  return str;
+}
+
+/** \brief Index of name in list (list.size() if not found) */
+unsigned find_name(const std::vector<std::string> &list, const cview name) {
+  for (unsigned i = 0; i < (unsigned)list.size(); i++) {
+    if (list[i].size() == name.len &&
+        strncmp(list[i].c_str(), name.ptr, name.len) == 0) {
+      return i;
+    }
+  }
+  return (unsigned)list.size();
+}
+
+/** \brief Index of the slot named name (slots.size() if not found) */
+unsigned find_slot(const std::vector<LandmarkSlot> &slots, const cview name) {
+  for (unsigned i = 0; i < (unsigned)slots.size(); i++) {
+    if (slots[i].name.size() == name.len &&
+        strncmp(slots[i].name.c_str(), name.ptr, name.len) == 0) {
+      return i;
+    }
+  }
+  return (unsigned)slots.size();
+}
+
+/** \brief Store index of a slot in a file (landmark_absent if missing) */
+unsigned slot_index(const LandmarkSlot &slot, const LandmarkIndex &index) {
+  return slot.id != NUM_LANDMARKS ? index[slot.id] : index.find(slot.name);
+}
+
+typedef dd_stride_iterator<const float> ColumnIter;
+
+/** \brief x & y columns (1 value per frame) of a bound landmark slot */
+struct Column {
+  ColumnIter x;
+  ColumnIter y;
+};
+
+/** \brief Columns of frames [first, first + frames) (range checked once) */
+Column get_column(const LandmarkRef &ref, const FrameStore &input,
+                  const FrameStore &ground, const size_t first,
+                  const size_t frames) {
+  const FrameStore &store = ref.store == 0 ? input : ground;
+  POW2_VERIFY_MSG(ref.landmark < store.numLandmarks() &&
+                      first + frames <= store.numFrames(),
+                  "Feature column out of bounds", 0);
+  Column col;
+  col.x = ColumnIter(store.xs(first) + ref.landmark, store.numLandmarks());
+  col.y = ColumnIter(store.ys(first) + ref.landmark, store.numLandmarks());
+  return col;
+}
+
+float abs_diff(const float a, const float b) { return std::fabs(a - b); }
+
+}  // namespace
+
+bool FeatureProgram::compile(const cview spec, const char *source) {
+  names.clear();
+  code.clear();
+  landmarks.clear();
+
+  const char *curr = spec.ptr;
+  const char *end = spec.end();
+  unsigned line_num = 0;
+  std::vector<cview> args;
+  while (curr < end) {
+    // next line (w/o comment)
+    const char *nl = (const char *)memchr(curr, '\n', end - curr);
+    const char *line_end = nl ? nl : end;
+    cview line(curr, line_end - curr);
+    curr = nl ? nl + 1 : end;
+    line_num++;
+
+    const char *comment = (const char *)memchr(line.ptr, '#', line.len);
+    if (comment) line.len = comment - line.ptr;
+    line = trim(line);
+    if (line.len == 0) continue;
+
+    // name = op(arg, arg[, arg])
+    const char *eq = (const char *)memchr(line.ptr, '=', line.len);
+    const char *open = (const char *)memchr(line.ptr, '(', line.len);
+    const char *close = line.end() - 1;
+    if (!eq || !open || open < eq || *close != ')') {
+      printf("Feature spec %s:%u: expected \"name = op(args)\"\n", source,
+             line_num);
+      return false;
+    }
+    const cview name = trim(cview(line.ptr, eq - line.ptr));
+    const cview op_name = trim(cview(eq + 1, open - eq - 1));
+    if (name.len == 0 || find_name(names, name) < names.size()) {
+      printf("Feature spec %s:%u: missing or duplicate feature name\n",
+             source, line_num);
+      return false;
+    }
+
+    const OpInfo *info = nullptr;
+    for (const OpInfo &entry : op_table) {
+      if (strlen(entry.name) == op_name.len &&
+          strncmp(entry.name, op_name.ptr, op_name.len) == 0) {
+        info = &entry;
+      }
+    }
+    if (!info) {
+      printf("Feature spec %s:%u: unknown op \"%.*s\"\n", source, line_num,
+             (int)op_name.len, op_name.ptr);
+      return false;
+    }
+
+    const unsigned num_args =
+        StrSpace::tokenize(cview(open + 1, close - open - 1), ',', args);
+    if (num_args != info->num_args) {
+      printf("Feature spec %s:%u: %s takes %u args (got %u)\n", source,
+             line_num, info->name, info->num_args, num_args);
+      return false;
+    }
+
+    FeatureInstr instr;
+    instr.op = info->op;
+    for (unsigned i = 0; i < num_args; i++) {
+      const cview arg = trim(args[i]);
+      if (info->feature_args) {
+        // must reference an earlier feature
+        instr.args[i] = find_name(names, arg);
+        if (instr.args[i] == names.size()) {
+          printf("Feature spec %s:%u: undefined feature \"%.*s\"\n", source,
+                 line_num, (int)arg.len, arg.ptr);
+          return false;
+        }
+      } else {
+        // landmark slots are shared by every instruction
+        instr.args[i] = find_slot(landmarks, arg);
+        if (instr.args[i] == landmarks.size()) {
+          LandmarkSlot slot;
+          slot.id = find_landmark(arg);
+          slot.name.assign(arg.ptr, arg.len);
+          landmarks.push_back(slot);
+        }
+      }
+    }
+    code.push_back(instr);
+    names.push_back(std::string(name.ptr, name.len));
+  }
+
+  if (code.empty()) {
+    printf("Feature spec %s: no features defined\n", source);
+    return false;
+  }
+  return true;
+}
+
+bool FeatureProgram::load(const char *file) {
+  ddFileIO<> spec_io;
+  if (!spec_io.open(file, ddIOflag::READ_MAP)) return false;
+  return compile(spec_io.mappedView(), file);
+}
+
+bool FeatureProgram::link(const LandmarkIndex &i_index,
+                          const LandmarkIndex &gt_index,
+                          std::vector<LandmarkRef> &bound) const {
+  bound.resize(landmarks.size());
+  for (unsigned i = 0; i < (unsigned)landmarks.size(); i++) {
+    // input takes precedence
+    const unsigned in_idx = slot_index(landmarks[i], i_index);
+    const unsigned gt_idx = slot_index(landmarks[i], gt_index);
+    if (in_idx != landmark_absent) {
+      bound[i].store = 0;
+      bound[i].landmark = in_idx;
+    } else if (gt_idx != landmark_absent) {
+      bound[i].store = 1;
+      bound[i].landmark = gt_idx;
+    } else {
+      printf("    Features: missing column %s x\n",
+             landmarks[i].name.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+void FeatureProgram::evaluate(const std::vector<LandmarkRef> &bound,
+                              const FrameStore &input,
+                              const FrameStore &ground, const size_t first,
+                              const size_t frames,
+                              dd_array<float> &columns) const {
+  // every column is overwritten below
+  columns.resize(code.size() * frames, dd_no_init);
+
+  // each instruction fills its whole column before the next one runs
+  for (size_t i = 0; i < code.size(); i++) {
+    const FeatureInstr &instr = code[i];
+    float *out = columns.span(i * frames, frames).data();
+
+    if (instr.op == FeatureOp::RATIO) {
+      const float *num = columns.data() + instr.args[0] * frames;
+      const float *den = columns.data() + instr.args[1] * frames;
+      dd_transform(num, num + frames, den, out, std::divides<float>());
+      continue;
+    }
+
+    // ops on 1 column per side are std transforms over the strided columns
+    const Column a =
+        get_column(bound[instr.args[0]], input, ground, first, frames);
+    const Column b =
+        get_column(bound[instr.args[1]], input, ground, first, frames);
+    switch (instr.op) {
+      case FeatureOp::DX:
+        dd_transform(a.x, a.x + frames, b.x, out, std::minus<float>());
+        break;
+      case FeatureOp::DY:
+        dd_transform(a.y, a.y + frames, b.y, out, std::minus<float>());
+        break;
+      case FeatureOp::ABS_DX:
+        dd_transform(a.x, a.x + frames, b.x, out, abs_diff);
+        break;
+      case FeatureOp::ABS_DY:
+        dd_transform(a.y, a.y + frames, b.y, out, abs_diff);
+        break;
+      case FeatureOp::DIST:
+        for (size_t f = 0; f < frames; f++) {
+          const float dx = a.x[f] - b.x[f];
+          const float dy = a.y[f] - b.y[f];
+          out[f] = std::sqrt(dx * dx + dy * dy);
+        }
+        break;
+      case FeatureOp::ANGLE:
+        for (size_t f = 0; f < frames; f++) {
+          out[f] = (float)std::atan2((double)a.y[f] - b.y[f],
+                                     (double)a.x[f] - b.x[f]);
+        }
+        break;
+      case FeatureOp::SYMMETRY: {
+        const Column m =
+            get_column(bound[instr.args[2]], input, ground, first, frames);
+        for (size_t f = 0; f < frames; f++) {
+          const float mx = m.x[f], my = m.y[f];
+          const float lx = a.x[f] - mx, ly = a.y[f] - my;
+          const float rx = b.x[f] - mx, ry = b.y[f] - my;
+          const float l_dist = std::sqrt(lx * lx + ly * ly);
+          const float r_dist = std::sqrt(rx * rx + ry * ry);
+          const float total = l_dist + r_dist;
+          out[f] = total > 0.f ? (l_dist - r_dist) / total : 0.f;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+}
+
+void FeatureProgram::write(const dd_array<float> &columns,
+                           const size_t frames, ddFileWriter &out,
+                           const unsigned decimals) const {
+  const float *vals = columns.span(0, code.size() * frames).data();
+  for (size_t f = 0; f < frames; f++) {
+    for (size_t i = 0; i < code.size(); i++) {
+      if (i > 0) out.put(' ');
+      out.writeFloat(vals[i * frames + f], decimals);
+    }
+    out.put('\n');
+  }
+}
+
+const char *mouth_feature_spec() {
+  return "mouth_width = absdx(Oral commisure (L), Oral commisure (R))\n"
+         "dental_show = absdy(Dental show (Top), Dental show (Bottom))\n"
+         "smile_angle = angle(Oral commisure (L), Dental show (Bottom))\n";
+}
@@ -0,0 +1,246 @@
+#include "JobPool.h"
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+void append_v(std::string &text, const char *fmt, va_list args) {
+  char buff[512];
+  va_list copy;
+  va_copy(copy, args);
+  const int len = vsnprintf(buff, sizeof(buff), fmt, args);
+  if (len < 0) {
+    va_end(copy);
+    return;
+  }
+  if ((size_t)len < sizeof(buff)) {
+    text.append(buff, len);
+  } else {
+    // long message, format again straight into the string
+    const size_t start = text.size();
+    text.resize(start + len + 1);
+    vsnprintf(&text[start], len + 1, fmt, copy);
+    text.resize(start + len);
+  }
+  va_end(copy);
+}
+
+}  // namespace
+
+void JobLog::post(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  append_v(text, fmt, args);
+  va_end(args);
+}
+
+void JobLog::flush() {
+  fwrite(text.data(), 1, text.size(), stdout);
+  text.clear();
+}
+
+void job_post(JobLog *log, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  if (log) {
+    append_v(log->text, fmt, args);
+  } else {
+    vprintf(fmt, args);
+  }
+  va_end(args);
+}
+
+unsigned job_threads(const unsigned requested) {
+  if (requested > 0) return requested;
+  const unsigned cores = std::thread::hardware_concurrency();
+  return cores > 0 ? cores : 1;
+}
+
+void JobRetirer::done(const unsigned idx) {
+  std::lock_guard<std::mutex> guard(lock);
+  completed[idx] = 1;
+  while (retired < completed.size() && completed[retired]) {
+    finish(retired++);
+  }
+}
+
+void run_jobs(const unsigned count, const unsigned threads,
+              const std::vector<unsigned> &schedule,
+              const std::function<void(unsigned)> &job,
+              const std::function<void(unsigned)> &finish) {
+  if (threads <= 1 || count <= 1) {
+    for (unsigned i = 0; i < count; i++) {
+      job(i);
+      finish(i);
+    }
+    return;
+  }
+
+  // workers claim the next scheduled job, finished jobs are retired in order
+  std::atomic<unsigned> next(0);
+  JobRetirer retirer(count, finish);
+
+  auto worker = [&]() {
+    for (unsigned s = next++; s < count; s = next++) {
+      const unsigned idx = schedule.empty() ? s : schedule[s];
+      job(idx);
+      retirer.done(idx);
+    }
+  };
+
+  const unsigned num_workers = threads < count ? threads : count;
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < num_workers; i++) {
+    pool.push_back(std::thread(worker));
+  }
+  worker();
+  for (auto &t : pool) t.join();
+}
+
+void run_window(const unsigned threads, const unsigned window,
+                const std::function<bool(unsigned)> &fetch,
+                const std::function<void(unsigned)> &job,
+                const std::function<void(unsigned)> &finish) {
+  if (threads <= 1 || window <= 1) {
+    while (fetch(0)) {
+      job(0);
+      finish(0);
+    }
+    return;
+  }
+
+  // workers fetch into the next free slot & retire finished slots in order
+  std::mutex lock;
+  std::condition_variable slot_freed;
+  std::vector<char> completed(window, 0);
+  size_t fetched = 0, retired = 0;
+  bool ended = false;
+
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+      slot_freed.wait(guard,
+                      [&]() { return ended || fetched - retired < window; });
+      if (ended) return;
+      const unsigned slot = (unsigned)(fetched % window);
+      if (!fetch(slot)) {
+        ended = true;
+        slot_freed.notify_all();
+        return;
+      }
+      fetched++;
+
+      guard.unlock();
+      job(slot);
+      guard.lock();
+
+      completed[slot] = 1;
+      while (retired < fetched && completed[retired % window]) {
+        const unsigned r = (unsigned)(retired % window);
+        completed[r] = 0;
+        finish(r);
+        retired++;
+      }
+      slot_freed.notify_all();
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < threads; i++) {
+    pool.push_back(std::thread(worker));
+  }
+  worker();
+  for (auto &t : pool) t.join();
+}
+
+namespace {
+
+// index of the TaskPool worker running on this thread (none outside run)
+const unsigned no_worker = ~0u;
+thread_local unsigned s_worker = no_worker;
+
+}  // namespace
+
+TaskPool::TaskPool(const unsigned threads)
+    : pending(0), queued(0), next_worker(0) {
+  for (unsigned i = 0; i < (threads > 0 ? threads : 1); i++) {
+    workers.push_back(std::unique_ptr<Worker>(new Worker()));
+  }
+}
+
+void TaskPool::spawn(Task task) {
+  unsigned w = s_worker;
+  if (w == no_worker) {
+    w = next_worker;
+    next_worker = (next_worker + 1) % workers.size();
+  }
+  pending++;
+  queued++;
+  {
+    std::lock_guard<std::mutex> guard(workers[w]->lock);
+    workers[w]->tasks.push_back(std::move(task));
+  }
+  wake(false);
+}
+
+void TaskPool::wake(const bool all) {
+  // an idle worker checks its wait condition under idle_lock, so taking it
+  // here means the notify can't slip in b/t its check & its wait
+  { std::lock_guard<std::mutex> guard(idle_lock); }
+  if (all) {
+    idle.notify_all();
+  } else {
+    idle.notify_one();
+  }
+}
+
+bool TaskPool::pop(const unsigned w, Task &task) {
+  std::lock_guard<std::mutex> guard(workers[w]->lock);
+  if (workers[w]->tasks.empty()) return false;
+  task = std::move(workers[w]->tasks.back());
+  workers[w]->tasks.pop_back();
+  queued--;
+  return true;
+}
+
+bool TaskPool::steal(const unsigned w, Task &task) {
+  for (unsigned i = 1; i < workers.size(); i++) {
+    Worker &victim = *workers[(w + i) % workers.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (victim.tasks.empty()) continue;
+    task = std::move(victim.tasks.front());
+    victim.tasks.pop_front();
+    queued--;
+    return true;
+  }
+  return false;
+}
+
+void TaskPool::work(const unsigned w) {
+  s_worker = w;
+  Task task;
+  while (pending > 0) {
+    if (pop(w, task) || steal(w, task)) {
+      task();
+      task = nullptr;
+      if (--pending == 0) wake(true);
+    } else {
+      // sleep until a task is queued or every task is done
+      std::unique_lock<std::mutex> guard(idle_lock);
+      idle.wait(guard, [this]() { return queued > 0 || pending == 0; });
+    }
+  }
+  s_worker = no_worker;
+}
+
+void TaskPool::run() {
+  std::vector<std::thread> pool;
+  for (unsigned i = 1; i < workers.size(); i++) {
+    pool.push_back(std::thread(&TaskPool::work, this, i));
+  }
+  work(0);
+  for (auto &t : pool) t.join();
+}
@@ -1,81 +1,233 @@
 #include "NormalParse.h"
 #include "StringLib.h"
+#include "BoundedQueue.h"
+#include <algorithm>
+#include <memory>
+#include <thread>
 
-output_data parse_csv(const Args& args) {
-	output_data out_d;
-	std::vector<unsigned> idxs;
+ColumnPlan resolve_columns(const cview header,
+                           const std::vector<std::string>& queries) {
+	ColumnPlan plan;
+	std::vector<cview> vals;
+	StrSpace::tokenize(header, ',', vals);
 
-	//ddIO io_handle;
-	ddFileIO<> io_handle;
-	bool opened = io_handle.open(args.input_file.c_str(), ddIOflag::READ);
-	bool capture_idx = true;
+	// record indices of queried columns, use to extract data
+	for (size_t c = 0; c < vals.size(); ++c) {
+		for(auto& query : queries) {
+			if (StrSpace::contains(vals[c], query.c_str())) {
+				plan.columns.push_back((unsigned)c);
+			}
+		}
+	}
 
-	if (opened) {
-		const char* line = io_handle.readNextLine();
-		
-		while(line) {
-			dd_array<cbuff<64>> vals = StrSpace::tokenize1024<64>(line, ",");
-			if (capture_idx) {
-				// record indices of queried columns, use to extract data
-				DD_FOREACH(cbuff<64>, buff, vals) {
-					for(auto& query : args.queries) {
-						if (buff.ptr->contains(query.c_str())) {
-							idxs.push_back(buff.i);
-							//printf("%s::%llu\n", buff.ptr->str(), (long long unsigned)buff.i);
-						}
-					}
-				}
-				// add header to output and record for mapping
-				out_d.push_back(std::vector<std::string>(idxs.size()));
-				for (size_t i = 0; i < idxs.size(); ++i) {
-					out_d[0][i] = vals[idxs[i]].str();
-				}
+	// unique columns to scan per row & where each output column reads from
+	plan.scan = plan.columns;
+	std::sort(plan.scan.begin(), plan.scan.end());
+	plan.scan.erase(std::unique(plan.scan.begin(), plan.scan.end()),
+									plan.scan.end());
+	for (auto& col : plan.columns) {
+		plan.slot.push_back((unsigned)(
+			std::lower_bound(plan.scan.begin(), plan.scan.end(), col) - 
+			plan.scan.begin()));
+	}
 
-				capture_idx = false;
-			} else {
-				// add new row to output
-				const size_t curr_spot = out_d.size();
-				out_d.push_back(std::vector<std::string>(idxs.size()));
-				for (size_t i = 0; i < idxs.size(); ++i) {
-					out_d[curr_spot][i] = vals[idxs[i]].str();
-				}
-			}
-			line = io_handle.readNextLine();
+	return plan;
+}
+
+ProjectionPlan resolve_projection(const cview header,
+                                  const std::vector<QuerySet>& sets) {
+	ProjectionPlan projection;
+	std::vector<cview> vals;
+	projection.fields = StrSpace::tokenize(header, ',', vals);
+
+	// scan union of every set's columns, point slots at the union
+	std::vector<unsigned> scan;
+	for (auto& set : sets) {
+		projection.plans.push_back(resolve_columns(header, set.queries));
+		const std::vector<unsigned>& cols = projection.plans.back().scan;
+		scan.insert(scan.end(), cols.begin(), cols.end());
+	}
+	std::sort(scan.begin(), scan.end());
+	scan.erase(std::unique(scan.begin(), scan.end()), scan.end());
+	for (auto& plan : projection.plans) {
+		plan.scan = scan;
+		for (size_t i = 0; i < plan.columns.size(); ++i) {
+			plan.slot[i] = (unsigned)(
+				std::lower_bound(scan.begin(), scan.end(), plan.columns[i]) -
+				scan.begin());
+		}
+	}
+	return projection;
+}
+
+const ProjectionPlan& SchemaCache::resolve(const cview header,
+                                           const std::vector<QuerySet>& sets) {
+	// fingerprint header, compare full text only on a hash match
+	const size_t hash = getCharHash(header);
+	std::lock_guard<std::mutex> guard(lock);
+	std::list<Schema>& bucket = schemas[hash];
+	for (auto& schema : bucket) {
+		if (schema.header.size() == header.len &&
+				memcmp(schema.header.data(), header.ptr, header.len) == 0) {
+			return schema.plan;
 		}
-		
 	}
 
-	return out_d;
+	bucket.push_back(Schema());
+	bucket.back().header.assign(header.ptr, header.len);
+	bucket.back().plan = resolve_projection(header, sets);
+	return bucket.back().plan;
 }
 
-void write_data(const Args& args, const output_data& data) {
-	//ddIO io_handle;
-	ddFileIO<> io_handle;
+void SchemaCache::report(const ProjectionPlan& plan, const char* source) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (std::find(reported.begin(), reported.end(), &plan) != reported.end()) {
+		return;
+	}
+	if (!reported.empty()) {
+		printf("Schema change in %s: %u columns\n", source, plan.fields);
+	}
+	reported.push_back(&plan);
+}
 
-#ifdef WIN32
-	//const char* slash = "\\";
-#else
-	//const char* slash = "/";
-#endif
+std::string output_file(const Args& args, const QuerySet& set) {
+	const std::string& dir = set.output_dir != "" ? set.output_dir
+	                                              : args.output_dir;
+	// add a separator if dir doesn't end w/ one
+	const bool slash = dir.empty() || dir.back() == '/' || dir.back() == '\\';
+	return dir + (slash ? "" : "/") + args.stripped_filename + "_out.csv";
+}
 
-	std::string outfile = args.output_dir + args.stripped_filename + "_out.csv";
-	printf("Writing %s\n", outfile.c_str());
-	bool opened = io_handle.open(outfile.c_str(), ddIOflag::WRITE);
+/** \brief Log input & output names of a file */
+void post_files(JobLog* log, const Args& args) {
+	job_post(log, "Input csv:  %s\n", args.input_file.c_str());
+	job_post(log, "Output csv: %s_out.csv\n", args.stripped_filename.c_str());
+	for (auto& set : args.query_sets) {
+		job_post(log, "Output dir: %s\n",
+						 set.output_dir != "" ? set.output_dir.c_str()
+						                      : args.output_dir.c_str());
+	}
+	job_post(log, "\n");
+}
 
-	if (opened) {
-		const char* delim = ",";
-		for (auto& row : data) {
-			size_t i = 0;
-			for (auto& column : row) {
-				io_handle.writeLine(column.c_str());
-				if (++i < row.size()) {
-					io_handle.writeLine(delim);
-				}
-			}
-			delim = " "; // 1st row is comma, other rows are space
-			io_handle.writeLine("\n");
+WriterSet memory_writers(const size_t count) {
+	WriterSet writers;
+	for (size_t i = 0; i < count; ++i) {
+		writers.push_back(std::unique_ptr<ddFileWriter>(new ddFileWriter(1 << 16)));
+		writers.back()->openMemory();
+	}
+	return writers;
+}
+
+void write_selected(const ProjectionPlan& projection,
+                    const std::vector<cview>& vals, const char delim,
+                    WriterSet& outs) {
+	for (size_t p = 0; p < projection.plans.size(); ++p) {
+		const ColumnPlan& plan = projection.plans[p];
+		ddFileWriter& out = *outs[p];
+		for (size_t i = 0; i < plan.slot.size(); ++i) {
+			if (i > 0) out.put(delim);
+			out.write(vals[plan.slot[i]]);
 		}
+		out.put('\n');
+	}
+}
+
+/** \brief Write queried columns of line as a delimited row of every set */
+void write_row(const ProjectionPlan& projection, const cview line,
+               const char delim, std::vector<cview>& vals, WriterSet& outs) {
+	StrSpace::select(line, ',', projection.plans[0].scan, vals);
+	write_selected(projection, vals, delim, outs);
+}
+
+/**
+ * \brief Write queried columns of each row of a chunk (space delimited).
+ * Returns false if the chunk hit an empty line (end of data)
+ */
+bool write_rows(const ProjectionPlan& projection, const cview chunk,
+                WriterSet& outs) {
+	std::vector<cview> vals;
+	const char* next = chunk.ptr;
+	while (next < chunk.end()) {
+		const cview line = StrSpace::next_line(next, chunk.end());
+		if (line.len == 0) return false;
+		write_row(projection, line, ' ', vals, outs);
 	}
+	return true;
+}
+
+const ProjectionPlan* stream_csv(const Args& args, SchemaCache* schemas,
+                                 JobLog* log) {
+	ddFileIO<> in_handle;
+	const bool opened = in_handle.open(args.input_file.c_str(), 
+																		 ddIOflag::READ_MAP);
+
+	// 1 output file per query set
+	WriterSet out_handles;
+	bool out_opened = true;
+	for (auto& set : args.query_sets) {
+		const std::string outfile = output_file(args, set);
+		job_post(log, "Writing %s\n", outfile.c_str());
+		out_handles.push_back(std::unique_ptr<ddFileWriter>(new ddFileWriter()));
+		if (!out_handles.back()->open(outfile.c_str(), ddIOflag::WRITE)) {
+			job_post(log, "Failed to open %s\n", outfile.c_str());
+			out_opened = false;
+		}
+	}
+	if (!out_opened || !opened || out_handles.empty()) return nullptr;
+
+	ProjectionPlan local_plan;
+	const ProjectionPlan* projection = nullptr;
+	std::vector<cview> vals;
+
+	cview line = in_handle.readNextView();
+	if (!line.isValid()) return nullptr;
+	if (schemas) {
+		projection = &schemas->resolve(line, args.query_sets);
+	} else {
+		local_plan = resolve_projection(line, args.query_sets);
+		projection = &local_plan;
+	}
+	// 1st row is comma, other rows are space
+	write_row(*projection, line, ',', vals, out_handles);
+
+	const unsigned threads = job_threads(args.jobs);
+	if (threads <= 1) {
+		// reader -> column selector -> buffered writers
+		line = in_handle.readNextView();
+		while(line.isValid()) {
+			write_row(*projection, line, ' ', vals, out_handles);
+			line = in_handle.readNextView();
+		}
+	} else {
+		// project chunks in parallel, write them out in file order (a window of
+		// chunks is in flight & written chunks release their mapped pages)
+		const unsigned window = threads * 2;
+		std::vector<cview> chunks(window);
+		std::vector<WriterSet> parts(window);
+		std::vector<char> complete(window, 0);
+		bool stopped = false;
+		run_window(threads, window,
+							 [&](const unsigned s) {
+								 if (stopped) return false;
+								 chunks[s] = in_handle.readNextChunk(parse_chunk_bytes);
+								 return chunks[s].isValid();
+							 },
+							 [&](const unsigned s) {
+								 parts[s] = memory_writers(out_handles.size());
+								 complete[s] = write_rows(*projection, chunks[s], parts[s]);
+							 },
+							 [&](const unsigned s) {
+								 // rows after an empty line are not part of the data
+								 for (size_t p = 0; p < out_handles.size() && !stopped; ++p) {
+									 out_handles[p]->write(parts[s][p]->view());
+								 }
+								 stopped = stopped || !complete[s];
+								 parts[s].clear();
+								 in_handle.retireChunk(chunks[s]);
+							 });
+	}
+	return projection == &local_plan ? nullptr : projection;
 }
 
 std::vector<std::string> extract_queries(const char* file) {
@@ -100,9 +252,176 @@ std::vector<std::string> extract_queries(const char* file) {
 	return out_q;
 }
 
+/** \brief Rows of a file moving thru the conversion pipeline */
+struct RowBatch {
+	explicit RowBatch(const size_t outputs) : out(memory_writers(outputs)) {}
+
+	unsigned file = 0;
+	unsigned seq = 0;                    // order within file (0 is the header)
+	bool last = false;                   // last batch of file
+	bool complete = true;                // false if rows hit an empty line
+	std::shared_ptr<ddFileIO<>> source;  // keeps mapped rows alive
+	cview rows;
+	const ProjectionPlan* plan = nullptr;
+	WriterSet out;                       // formatted rows of each query set
+};
+
+void pipeline_csvs(const Args& args, const std::vector<std::string>& files) {
+	const unsigned num_files = (unsigned)files.size();
+	const unsigned parsers = job_threads(args.jobs);
+	const size_t outputs = args.query_sets.size();
+	SchemaCache schemas;
+
+	BoundedQueue<RowBatch*> read_q("read -> parse", parsers * 4);
+	BoundedQueue<RowBatch*> write_q("parse -> write", parsers * 4, parsers);
+	// 1 token per batch not yet written: caps batches the writer holds back
+	// while it waits for an earlier (slow) batch
+	BoundedQueue<char> in_flight("batches in flight", parsers * 16);
+	StageClock read_clock("read", 1), parse_clock("parse", parsers),
+		write_clock("write", 1);
+
+	// reader: map files in order & cut them into newline-aligned batches
+	std::thread reader([&]() {
+		for (unsigned f = 0; f < num_files; f++) {
+			in_flight.push(0);
+			RowBatch* header = new RowBatch(outputs);
+			cview chunk;
+			{
+				StageTimer timer(read_clock);
+				header->file = f;
+				header->source = std::make_shared<ddFileIO<>>();
+				if (header->source->open(files[f].c_str(), ddIOflag::READ_MAP)) {
+					header->rows = header->source->readNextView();
+				}
+				if (header->rows.isValid()) {
+					header->plan = &schemas.resolve(header->rows, args.query_sets);
+					chunk = header->source->readNextChunk(pipeline_batch_bytes);
+				}
+				header->last = !chunk.isValid();
+			}
+			// header may be written & freed once pushed
+			const std::shared_ptr<ddFileIO<>> source = header->source;
+			const ProjectionPlan* plan = header->plan;
+			read_q.push(header);
+
+			// batches are cut as the in flight cap allows (pages of written
+			// batches are released by the writer)
+			for (unsigned seq = 1; chunk.isValid(); seq++) {
+				in_flight.push(0);
+				RowBatch* batch = new RowBatch(outputs);
+				{
+					StageTimer timer(read_clock);
+					batch->file = f;
+					batch->seq = seq;
+					batch->source = source;
+					batch->rows = chunk;
+					batch->plan = plan;
+					chunk = source->readNextChunk(pipeline_batch_bytes);
+					batch->last = !chunk.isValid();
+				}
+				read_q.push(batch);
+			}
+		}
+		read_q.producerDone();
+	});
+
+	// parsers: project queried columns of each batch into its own buffer
+	std::vector<std::thread> parse_pool;
+	for (unsigned i = 0; i < parsers; i++) {
+		parse_pool.push_back(std::thread([&]() {
+			RowBatch* batch = nullptr;
+			std::vector<cview> vals;
+			while (read_q.pop(batch)) {
+				{
+					StageTimer timer(parse_clock);
+					if (batch->seq == 0 && batch->plan) {
+						// 1st row is comma, other rows are space
+						write_row(*batch->plan, batch->rows, ',', vals, batch->out);
+					} else if (batch->plan) {
+						batch->complete = write_rows(*batch->plan, batch->rows, batch->out);
+					}
+				}
+				write_q.push(batch);
+			}
+			write_q.producerDone();
+		}));
+	}
+
+	// writer (this thread): batches arrive out of order, write them in order
+	std::map<std::pair<unsigned, unsigned>, RowBatch*> pending;
+	unsigned file = 0, seq = 0;
+	bool stopped = false;
+	WriterSet out_handles;
+	for (size_t p = 0; p < outputs; p++) {
+		out_handles.push_back(std::unique_ptr<ddFileWriter>(new ddFileWriter()));
+	}
+	RowBatch* batch = nullptr;
+	while (write_q.pop(batch)) {
+		pending[std::make_pair(batch->file, batch->seq)] = batch;
+		for (auto next = pending.find(std::make_pair(file, seq));
+				 next != pending.end();
+				 next = pending.find(std::make_pair(file, seq))) {
+			StageTimer timer(write_clock);
+			RowBatch* ready = next->second;
+			pending.erase(next);
+
+			if (seq == 0) {
+				// get input file and stripped file name
+				Args f_args = args;
+				f_args.input_file = files[file];
+				const size_t idx = f_args.input_file.find_last_of("/\\");
+				f_args.stripped_filename = f_args.input_file.substr(idx + 1);
+				f_args.stripped_filename = f_args.stripped_filename.substr(
+					0, f_args.stripped_filename.size() - 4);
+
+				if (ready->plan) schemas.report(*ready->plan, files[file].c_str());
+				post_files(nullptr, f_args);
+				bool opened = true;
+				for (size_t p = 0; p < outputs; p++) {
+					const std::string outfile = output_file(f_args, args.query_sets[p]);
+					printf("Writing %s\n", outfile.c_str());
+					if (!out_handles[p]->open(outfile.c_str(), ddIOflag::WRITE)) {
+						printf("Failed to open %s\n", outfile.c_str());
+						opened = false;
+					}
+				}
+				// skip the file's batches if an output can't be written
+				stopped = !opened;
+			}
+			// rows after an empty line are not part of the data
+			for (size_t p = 0; p < outputs && !stopped; p++) {
+				out_handles[p]->write(ready->out[p]->view());
+			}
+			stopped = stopped || !ready->complete;
+			if (ready->rows.isValid()) ready->source->retireChunk(ready->rows);
+			if (ready->last) {
+				for (auto& out_handle : out_handles) out_handle->close();
+				file++;
+				seq = 0;
+			} else {
+				seq++;
+			}
+			delete ready;
+			char token;
+			in_flight.tryPop(token);
+		}
+	}
+	reader.join();
+	for (auto& t : parse_pool) t.join();
+
+	printf("Pipeline stages:\n");
+	read_clock.report();
+	read_q.report();
+	parse_clock.report();
+	write_q.report();
+	in_flight.report();
+	write_clock.report();
+	printf("\n");
+}
+
 void create_formatted_csvs(Args args) {
 	// check arguments
-	if (args.queries.size() < 1) {
+	if (args.query_sets.empty()) {
 		printf("No queries provided to parse files. Skipping.\n\n");
 		return;
 	}
@@ -119,32 +438,63 @@ void create_formatted_csvs(Args args) {
 		ddFileIO<1024> io_handle;
 		bool opened = io_handle.open(args.input_dir.c_str(), ddIOflag::DIRECTORY);
 
-		if (opened) {
+		if (opened && args.pipeline) {
 			dd_array<std::string> files = io_handle.get_directory_files();
-			DD_FOREACH(std::string, file, files) {
-				// get input file and stripped file name
-				args.input_file = *file.ptr;
-				const size_t idx = args.input_file.find_last_of("/\\");
-				args.stripped_filename = args.input_file.substr(idx + 1);
-				args.stripped_filename = args.stripped_filename.substr(
-					0, args.stripped_filename.size() - 4);
-
-				printf("Input csv:  %s\n", args.input_file.c_str());
-				printf("Output csv: %s_out.csv\n", args.stripped_filename.c_str());
-				printf("Output dir: %s\n\n", args.output_dir.c_str());
-
-				output_data data = parse_csv(args);
-				// write to output directory
-				write_data(args, data);
+			pipeline_csvs(args, std::vector<std::string>(files.begin(), files.end()));
+		} else if (opened) {
+			dd_array<std::string> files = io_handle.get_directory_files();
+			const unsigned num_files = (unsigned)files.size();
+			const unsigned threads = job_threads(args.jobs);
+			SchemaCache schemas;
+			std::vector<JobLog> logs(num_files);
+			std::vector<const ProjectionPlan*> plans(num_files, nullptr);
+
+			// start largest files first so no thread is left w/ a big straggler
+			std::vector<unsigned> schedule;
+			if (threads > 1) {
+				std::vector<uintmax_t> sizes(num_files, 0);
+				for (unsigned i = 0; i < num_files; i++) {
+					std::error_code err;
+					const uintmax_t size = dd_fs::file_size(files[i], err);
+					sizes[i] = err ? 0 : size;
+					schedule.push_back(i);
+				}
+				std::stable_sort(schedule.begin(), schedule.end(),
+												 [&](const unsigned a, const unsigned b) {
+													 return sizes[a] > sizes[b];
+												 });
+				printf("Jobs: %u threads\n\n", threads);
 			}
+
+			auto job = [&](const unsigned i) {
+				// get input file and stripped file name
+				Args f_args = args;
+				f_args.input_file = files[i];
+				const size_t idx = f_args.input_file.find_last_of("/\\");
+				f_args.stripped_filename = f_args.input_file.substr(idx + 1);
+				f_args.stripped_filename = f_args.stripped_filename.substr(
+					0, f_args.stripped_filename.size() - 4);
+
+				JobLog& log = logs[i];
+				post_files(&log, f_args);
+
+				// stream to output directory (spare threads split the file)
+				f_args.jobs = threads > num_files ? threads / num_files : 1;
+				plans[i] = stream_csv(f_args, &schemas, &log);
+			};
+			// logs are printed in file order no matter which thread finished first
+			auto finish = [&](const unsigned i) {
+				if (plans[i]) schemas.report(*plans[i], files[i].c_str());
+				logs[i].flush();
+			};
+			run_jobs(num_files, threads, schedule, job, finish);
 		}
+	} else if (args.pipeline) {
+		pipeline_csvs(args, std::vector<std::string>(1, args.input_file));
 	} else {
-		printf("Input csv:  %s\n", args.input_file.c_str());
-		printf("Output csv: %s_out.csv\n", args.stripped_filename.c_str());
-		printf("Output dir: %s\n\n", args.output_dir.c_str());
-		output_data data = parse_csv(args);
-		// write to output directory
-		write_data(args, data);
+		post_files(nullptr, args);
+		// stream to output directory
+		stream_csv(args);
 	}
 }
 
@@ -154,24 +504,14 @@ dd_array<std::string> load_files(const char *directory) {
 	f_handle.open(directory, ddIOflag::DIRECTORY);
 	dd_array<std::string> unfiltered = f_handle.get_directory_files();
 
-	// check if file contains _s_out.csv or _v_out.csv
-	dd_array<unsigned> valid_files(unfiltered.size());
-	unsigned files_found = 0;
-	DD_FOREACH(std::string, file, unfiltered) {
-		if (file.ptr->find("_s_out.csv") != std::string::npos || 
-				file.ptr->find("_v_out.csv") != std::string::npos) {
-			// capture index of matching files
-			valid_files[files_found] = file.i;
-			files_found++;
+	// keep names of files that contain _s_out.csv or _v_out.csv
+	dd_array<std::string> out;
+	for (auto& file : unfiltered) {
+		if (file.find("_s_out.csv") != std::string::npos || 
+				file.find("_v_out.csv") != std::string::npos) {
+			out.push_back(file.substr(file.find_last_of("\\/") + 1));
 		}
 	}
 
-	// extract file names
-	dd_array<std::string> out(files_found);
-	for (unsigned i = 0; i < files_found; i++) {
-		std::string _s = unfiltered[valid_files[i]];
-		out[i] = _s.substr(_s.find_last_of("\\/") + 1);
-	}
-
 	return out;
 }
\ No newline at end of file
@@ -17,6 +17,12 @@ int main(int argc, char const *argv[]) {
 
 	// leave if help screen
 	if(args.help) return 0;
+
+	// raw data straight to the final datasets (no intermediate files)
+	if (args.fused_dir != "") {
+		create_fused_dataset(args);
+		return 0;
+	}
 	
 	// create csvs of original data split by query lists
 	create_formatted_csvs(args);
@@ -55,10 +61,17 @@ Args parse_args(std::vector<std::string>& args_vec) {
 							 "\t-f \t--file \t\tfile to convert\n"
 							 "\t-d \t--dir  \t\tDirectory of files to convert\n"
 							 "\t-q \t--query \tQueried columns to extract\n"
-							 "\t-o \t--out_dir \tOutput directory\n"
+							 "\t-o \t--out_dir \tOutput directory (of the preceding -q)\n"
+							 "\t-j \t--jobs \t\tThreads for directory conversion (0 = all cores)\n"
+							 "\t-p \t--pipeline \tRun conversion as staged reader/parser/writer threads\n"
 							 "\t-c \t--canonical \tFlag for creating canonical data\n"
 							 "\t-ci \t--canon_in \tLocation of canonical input files\n"
-							 "\t-cg \t--canon_gt \tLocation of canonical groundtruth files\n");
+							 "\t-cg \t--canon_gt \tLocation of canonical groundtruth files\n"
+							 "\t-cp \t--canon_precision \tDecimals per canonical value (default 6, max 9)\n"
+							 "\t-mf \t--mouth_features \tWrite mouth features of canonical input\n"
+							 "\t-fs \t--feature_spec \tFeature spec file evaluated on canonical data\n"
+							 "\t-F \t--fused \tWrite final canonical datasets from raw data (dir)\n"
+							 "\t-k \t--keep \t\tFused mode also writes intermediate csvs\n");
 			}
 			// extract file name to create output file name and directory
 			if (str == "-f" || str == "--file") {
@@ -77,7 +90,11 @@ Args parse_args(std::vector<std::string>& args_vec) {
 			// specify output directory
 			if (str == "-o" || str == "--out_dir") {
 				std::string out = check_value(i);
-				if(out != "") {
+				if(out != "" && !output.query_sets.empty() &&
+					 output.query_sets.back().output_dir == "") {
+					// pairs w/ the preceding query set
+					output.query_sets.back().output_dir = out;
+				} else if(out != "") {
 					output.output_dir = out;
 				}
 			}
@@ -93,9 +110,20 @@ Args parse_args(std::vector<std::string>& args_vec) {
 			if (str == "-q" || str == "--query") {
 				std::string in = check_value(i);
 				if(in != "") {
-					output.queries = extract_queries(in.c_str());
+					// each -q starts a query set (projected in the same read)
+					output.query_sets.push_back(QuerySet());
+					output.query_sets.back().queries = extract_queries(in.c_str());
 				}
 			}
+			// number of threads used to convert a directory
+			if (str == "-j" || str == "--jobs") {
+				std::string in = check_value(i);
+				if (in != "") output.jobs = (unsigned)strtoul(in.c_str(), nullptr, 10);
+			}
+			// run conversion (& canonical export) as a staged pipeline
+			if (str == "-p" || str == "--pipeline") {
+				output.pipeline = true;
+			}
 			// activate canonical flag
 			if (str == "-c" || str == "--canonical") {
 				output.create_canonical = true;
@@ -110,6 +138,34 @@ Args parse_args(std::vector<std::string>& args_vec) {
 				std::string in = check_value(i);
 				if (in != "") output.canon_gt = in;
 			}
+			// activate mouth feature stage (after canonical conversion)
+			if (str == "-mf" || str == "--mouth_features") {
+				output.mouth_features = true;
+			}
+			// derived features declared in a spec file (after canonical conversion)
+			if (str == "-fs" || str == "--feature_spec") {
+				std::string in = check_value(i);
+				if (in != "") output.feature_spec = in;
+			}
+			// raw -> projected -> canonical -> features in 1 pass
+			if (str == "-F" || str == "--fused") {
+				std::string in = check_value(i);
+				if (in != "") output.fused_dir = in;
+			}
+			// keep per-file outputs of the fused stages
+			if (str == "-k" || str == "--keep") {
+				output.keep_intermediate = true;
+			}
+			// number of decimals written per canonical value
+			if (str == "-cp" || str == "--canon_precision") {
+				std::string in = check_value(i);
+				if (in != "") output.canon_decimals = (unsigned)strtoul(in.c_str(), nullptr, 10);
+				if (output.canon_decimals > StrSpace::max_fixed_decimals) {
+					printf("Canonical precision %u not supported, using %u decimals\n",
+								 output.canon_decimals, StrSpace::max_fixed_decimals);
+					output.canon_decimals = StrSpace::max_fixed_decimals;
+				}
+			}
 		}
 	}
 
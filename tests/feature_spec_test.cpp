@@ -0,0 +1,121 @@
+/**
+ * \brief Checks that feature specs bind landmarks of the compiled schema &
+ * landmarks outside it (by header name) to the right store columns & that
+ * features evaluate on them. Exits w/ 1 on a failure
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "CanonicalParse.h"
+#include "FeatureSpec.h"
+
+namespace {
+
+unsigned num_failed = 0;
+
+void expect(const bool cond, const char *what) {
+  if (!cond) {
+    num_failed++;
+    printf("FAIL %s\n", what);
+  }
+}
+
+/** \brief Resolve a comma separated header into index (returns landmarks) */
+unsigned resolve_header(const char *header, LandmarkIndex &index,
+                        bool &time_flag) {
+  std::vector<cview> fields;
+  StrSpace::tokenize(cview(header, strlen(header)), ',', fields);
+  return vector_index(fields, index, time_flag);
+}
+
+/** \brief Frame f: landmark l is at (10 * f + l, 100 * f + l) */
+void fill_store(FrameStore &store, const unsigned landmarks,
+                const size_t frames) {
+  store.reset(landmarks, frames);
+  for (size_t f = 0; f < frames; f++) {
+    store.addFrame();
+    for (unsigned l = 0; l < landmarks; l++) {
+      store.xs(f)[l] = 10.f * f + l;
+      store.ys(f)[l] = 100.f * f + l;
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  // "Chin (M)" & "Jaw (L)" are not in the schema (input & ground truth)
+  const char *in_header =
+      "time,Oral commisure (L) x,Oral commisure (L) y,Chin (M) x,Chin (M) y,"
+      "Oral commisure (R) x,Oral commisure (R) y";
+  const char *gt_header =
+      "Lateral canthus (R) x,Lateral canthus (R) y,Jaw (L) x,Jaw (L) y";
+
+  LandmarkIndex i_index, gt_index;
+  bool in_time = false, gt_time = false;
+  expect(resolve_header(in_header, i_index, in_time) == 3,
+         "input landmark count");
+  expect(resolve_header(gt_header, gt_index, gt_time) == 2,
+         "ground truth landmark count");
+  expect(in_time && !gt_time, "time columns");
+  expect(i_index[ORAL_COMMISURE_L] == 0 && i_index[ORAL_COMMISURE_R] == 2,
+         "schema landmarks use the dense table");
+  expect(!i_index.has(LATERAL_CANTHUS_R) && gt_index[LATERAL_CANTHUS_R] == 0,
+         "schema landmark of ground truth");
+  expect(i_index.find("Chin (M)") == 1 && gt_index.find("Jaw (L)") == 1,
+         "landmarks outside the schema keep their own slot");
+  expect(i_index.find("Jaw (L)") == landmark_absent, "missing extra landmark");
+
+  const char *spec =
+      "# mixes schema & non-schema landmarks\n"
+      "chin_drop = dy(Chin (M), Oral commisure (L))\n"
+      "jaw_width = absdx(Jaw (L), Lateral canthus (R))\n"
+      "mouth_width = absdx(Oral commisure (L), Oral commisure (R))\n"
+      "ratio = ratio(chin_drop, mouth_width)\n";
+  FeatureProgram program;
+  expect(program.compile(cview(spec, strlen(spec)), "test spec"),
+         "spec w/ landmarks outside the schema compiles");
+  expect(program.landmarks.size() == 5, "landmark slots");
+  expect(program.landmarks[0].id == NUM_LANDMARKS &&
+             program.landmarks[0].name == "Chin (M)",
+         "non-schema slot keeps its name");
+  expect(program.landmarks[1].id == ORAL_COMMISURE_L,
+         "schema slot resolves to its landmark");
+
+  std::vector<LandmarkRef> bound;
+  expect(program.link(i_index, gt_index, bound), "link");
+  expect(bound.size() == 5 && bound[0].store == 0 && bound[0].landmark == 1,
+         "Chin (M) bound to input column 1");
+  expect(bound.size() == 5 && bound[2].store == 1 && bound[2].landmark == 1,
+         "Jaw (L) bound to ground truth column 1");
+
+  // evaluate frames [1, 3) of a 3 frame session
+  FrameStore input, ground;
+  fill_store(input, 3, 3);
+  fill_store(ground, 2, 3);
+  dd_array<float> columns;
+  program.evaluate(bound, input, ground, 1, 2, columns);
+  expect(columns.size() == 8, "feature columns");
+  if (columns.size() == 8) {
+    // chin_drop = y(chin) - y(oral l) = 1, jaw_width = |x(jaw) - x(canth)| = 1
+    // mouth_width = |x(oral l) - x(oral r)| = 2
+    const float expected[8] = {1.f, 1.f, 1.f, 1.f, 2.f, 2.f, 0.5f, 0.5f};
+    for (unsigned i = 0; i < 8; i++) {
+      expect(std::fabs(columns[i] - expected[i]) < 1e-6f, "feature value");
+    }
+  }
+
+  // a landmark no file has fails at link time, not compile time
+  const char *missing_spec = "nose = dx(Nose tip, Oral commisure (L))\n";
+  FeatureProgram missing;
+  expect(missing.compile(cview(missing_spec, strlen(missing_spec)),
+                         "missing spec"),
+         "spec w/ an unknown landmark compiles");
+  expect(!missing.link(i_index, gt_index, bound),
+         "link fails on a landmark no file has");
+
+  printf("feature_spec: %u failed\n", num_failed);
+  return num_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/**
+ * \brief Checks StrSpace::parse_float against strtod on every field of the
+ * csvs in a directory (argv[1]) & on edge cases. Exits w/ 1 on a mismatch
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "StringLib.h"
+#include "ddFileIO.h"
+
+namespace {
+
+unsigned num_checked = 0;
+unsigned num_failed = 0;
+
+/** \brief Same float (bitwise, any nan matches any nan) */
+bool same_float(const float a, const float b) {
+  if (std::isnan(a) || std::isnan(b)) return std::isnan(a) && std::isnan(b);
+  return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+/** \brief Field w/ control chars escaped (for messages) */
+std::string printable(const std::string &field) {
+  std::string out;
+  for (const char c : field) {
+    if (c == '\r') {
+      out += "\\r";
+    } else if (c == '\n') {
+      out += "\\n";
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+/**
+ * \brief parse_float of [str, str + len) in a buffer of len + tail chars must
+ * match (float)strtod of the field alone (value & chars converted)
+ */
+void check(const char *str, const size_t len, const char *tail = "") {
+  const std::string field(str, len);
+  char *nxt = nullptr;
+  const float expected = (float)std::strtod(field.c_str(), &nxt);
+  const size_t expected_len = nxt - field.c_str();
+
+  const std::string buff = field + tail;
+  float val = 0.f;
+  const char *end = StrSpace::parse_float(buff.c_str(), buff.c_str() + len,
+                                          val);
+  const size_t parsed_len = end - buff.c_str();
+  const bool ok = parsed_len == expected_len &&
+                  (expected_len == 0 || same_float(val, expected));
+
+  num_checked++;
+  if (!ok) {
+    num_failed++;
+    printf("FAIL \"%s\": got %.9g (%zu chars), expected %.9g (%zu chars)\n",
+           printable(field).c_str(), val, parsed_len, expected,
+           expected_len);
+  }
+}
+
+void check(const char *str, const char *tail = "") {
+  check(str, strlen(str), tail);
+}
+
+/** \brief Check every comma separated field of every line of a csv */
+void check_file(const char *file) {
+  ddFileIO<> io;
+  if (!io.open(file, ddIOflag::READ_MAP)) {
+    printf("FAIL could not open %s\n", file);
+    num_failed++;
+    return;
+  }
+  std::vector<cview> fields;
+  cview line = io.readNextView();
+  while (line.isValid()) {
+    StrSpace::tokenize(line, ',', fields);
+    // the next field/line stays in the buffer (parse_float must stop at end)
+    for (const cview &field : fields) check(field.ptr, field.len, ",9\n9");
+    line = io.readNextView();
+  }
+}
+
+}  // namespace
+
+int main(int argc, char const *argv[]) {
+  // edge cases (the tail is in memory right after the field)
+  const char *cases[] = {
+      // empty & signed zeros
+      "", "-0", "+0", "0", "-0.0",
+      // denormals, overflow & precision limits
+      "1e-40", "1.4e-45", "1e-46", "1e-320", "1e39", "-1e39", "3.4028235e38",
+      "1e308", "1e400", "0.1", "0.000001", "1e22", "1e23",
+      "123456789012345678901234567890", "9007199254740993",
+      "1.00000005960464477539062500001",
+      // hex, inf & nan
+      "0x1A", "0x1p-3", "-0X.8", "0x", "inf", "-inf", "infinity", "nan",
+      "-nan", "NaN(1)",
+      // carriage returns, whitespace & partial numbers
+      "1.5\r", "\r", "\r5", "  7", "abc", "-", ".", "1e", "1e+", ".5", "5.",
+  };
+  for (const char *str : cases) {
+    check(str);
+    check(str, "\n123");
+    check(str, ",0x10");
+  }
+
+  if (argc > 1) {
+    ddFileIO<> dir;
+    if (!dir.open(argv[1], ddIOflag::DIRECTORY)) {
+      printf("FAIL could not open directory %s\n", argv[1]);
+      return 1;
+    }
+    for (const std::string &file : dir.get_directory_files()) {
+      check_file(file.c_str());
+    }
+  }
+
+  printf("parse_float: %u fields checked, %u failed\n", num_checked,
+         num_failed);
+  return num_failed == 0 ? 0 : 1;
+}